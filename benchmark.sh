@@ -0,0 +1,87 @@
+#!/bin/bash
+
+# Usage: ./benchmark.sh "path/to/mapper [flags]" ["path/to/other/mapper [flags]" ...]
+#
+# Times each mapper command on the same circuits and couplings, and checks
+# that every command produces the same output as the first one.
+# Build a baseline binary from an older commit to measure a speedup, e.g.
+#   git stash; make; cp mapper mapper-baseline; git stash pop; make
+#   ./benchmark.sh ./mapper-baseline ./mapper
+# Or compare options of the same binary, e.g.
+#   ./benchmark.sh "./mapper -order int" "./mapper -order path"
+
+# Output Directory
+output=${OUTPUT:-benchmark/}
+
+# Circuits to Benchmark
+circuits=${CIRCUITS:-"./circuits/large/*.qasm"}
+
+# Couplings to Benchmark
+couplings=${COUPLINGS:-"./couplings/tokyo.txt"}
+
+# Seconds before a run is Killed
+limit=${TIMEOUT:-600}
+
+# (*).qasm Capture Regex
+qasmregex=".*/(.*).qasm"
+
+# (*).txt Capture Regex
+txtregex=".*/(.*).txt"
+
+# Mappers to Compare
+mappers=("$@")
+if [[ ${#mappers[@]} -eq 0 ]]
+then
+    mappers=("./mapper")
+fi
+
+# Hide excessive trap messages
+trap "" SIGABRT
+
+# Make Output Directory
+mkdir -p $output
+
+# Make Record File
+record=$output/record.txt
+: > $record
+
+# For every QASM
+for circuitfile in $circuits; do
+    # For every Coupling Graph
+    for couplingfile in $couplings; do
+        # Capture QASM name
+        if [[ $circuitfile =~ $qasmregex ]]
+        then
+            circuitname="${BASH_REMATCH[1]}"
+        else
+            echo "$circuitfile doesn't match"
+        fi
+        # Capture Coupling Graph name
+        if [[ $couplingfile =~ $txtregex ]]
+        then
+            couplingname="${BASH_REMATCH[1]}"
+        else
+            echo "$couplingfile doesn't match"
+        fi
+        # For every Mapper
+        for index in ${!mappers[@]}; do
+            mapper=(${mappers[$index]})
+            result=$output/$circuitname--$couplingname--$index.txt
+            # Output to stdout
+            echo "Testing $circuitname on $couplingname with ${mappers[$index]}" | tee -a $record
+            # Run mapper on QASM and Coupling Graph to Output File
+            time (timeout $limit ${mapper[0]} $circuitfile $couplingfile ${mapper[@]:1} 2>&1) \
+                1> $result \
+                2>> $record
+            head -n 4 $result >> $record
+            # Compare against the first Mapper
+            if ! cmp -s $output/$circuitname--$couplingname--0.txt $result
+            then
+                echo "${mappers[$index]} output differs from ${mappers[0]}" | tee -a $record
+            fi
+        done
+    done
+done
+
+# Summarize Times
+grep -E "^(Testing|real)|differs" $record
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Usage: ./scaling.sh [flags]
+#
+# Runs benchmark.sh with the same mapper flags on 1, 2, 4 and 8 threads,
+# then prints the real time of every thread count per circuit.
+# Every thread count must produce the same output as 1 thread.
+
+# Mapper Binary
+mapper=${MAPPER:-"./mapper"}
+
+# Thread Counts to Compare
+threads=${THREADS:-"1 2 4 8"}
+
+# Output Directory
+output=${OUTPUT:-benchmark/}
+
+# One Mapper per Thread Count
+mappers=()
+for count in $threads; do
+    mappers+=("$mapper $* -j $count")
+done
+
+OUTPUT=$output ./benchmark.sh "${mappers[@]}" > /dev/null
+
+# Real Time per Thread Count
+echo "circuit coupling threads=($threads)"
+awk '
+    /^Testing/ { circuit = $2 " " $4 }
+    /^real/ { times[circuit] = times[circuit] " " $2 }
+    /differs/ { differs[circuit] = 1 }
+    END {
+        for (circuit in times) {
+            print circuit times[circuit] (differs[circuit] ? " (output differs)" : "")
+        }
+    }
+' $output/record.txt | sort
@@ -0,0 +1,142 @@
+#ifndef CIRCUITWRITER_HPP
+#define CIRCUITWRITER_HPP
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+using namespace std;
+
+/**
+ * Buffered Writer of a compiled Circuit straight to a file descriptor
+ * Integers are formatted in place in the buffer, so emitting a gate
+ * allocates nothing and the output is never held in memory as a whole
+ */
+class CircuitWriter {
+  public:
+    explicit CircuitWriter(int fd)
+        : fd(fd),
+          size(0),
+          failed(false) {}
+
+    ~CircuitWriter() { flush(); }
+
+    CircuitWriter(const CircuitWriter &) = delete;
+    CircuitWriter &operator=(const CircuitWriter &) = delete;
+
+    CircuitWriter &operator<<(const char *text)
+    {
+        append(text, strlen(text));
+        return *this;
+    }
+
+    CircuitWriter &operator<<(const string &text)
+    {
+        append(text.data(), text.size());
+        return *this;
+    }
+
+    CircuitWriter &operator<<(long long value)
+    {
+        if (CAPACITY - size < MAX_DIGITS)
+        {
+            flush();
+        }
+        unsigned long long magnitude = value < 0 ? 0ULL - value : value;
+        char *end = &buffer[size] + MAX_DIGITS;
+        char *begin = end;
+        do
+        {
+            *--begin = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (value < 0)
+        {
+            *--begin = '-';
+        }
+        memmove(&buffer[size], begin, end - begin);
+        size += end - begin;
+        return *this;
+    }
+
+    CircuitWriter &operator<<(int value) { return *this << (long long)value; }
+
+    CircuitWriter &operator<<(unsigned int value) { return *this << (long long)value; }
+
+    CircuitWriter &operator<<(size_t value) { return *this << (long long)value; }
+
+    // Copy the rest of another file descriptor through the buffer
+    bool copy(int input_fd)
+    {
+        flush();
+        while (!failed)
+        {
+            ssize_t length = read(input_fd, &buffer[0], CAPACITY);
+            if (length < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (length <= 0)
+            {
+                return length == 0;
+            }
+            size = length;
+            flush();
+        }
+        return false;
+    }
+
+    // False once any write failed
+    bool flush()
+    {
+        write_all(&buffer[0], size);
+        size = 0;
+        return !failed;
+    }
+
+  private:
+    static const size_t CAPACITY = 1 << 16;
+    static const size_t MAX_DIGITS = 20;
+
+    int fd;
+    char buffer[CAPACITY];
+    size_t size;
+    bool failed;
+
+    void append(const char *text, size_t length)
+    {
+        if (CAPACITY - size < length)
+        {
+            flush();
+            // Longer than the buffer
+            if (length > CAPACITY)
+            {
+                write_all(text, length);
+                return;
+            }
+        }
+        memcpy(&buffer[size], text, length);
+        size += length;
+    }
+
+    void write_all(const char *text, size_t length)
+    {
+        while (length > 0 && !failed)
+        {
+            ssize_t written = write(fd, text, length);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                failed = true;
+                return;
+            }
+            text += written;
+            length -= written;
+        }
+    }
+};
+
+#endif
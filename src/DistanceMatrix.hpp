@@ -0,0 +1,99 @@
+#ifndef DISTANCEMATRIX_HPP
+#define DISTANCEMATRIX_HPP
+
+#include <vector>
+#include <set>
+#include <cassert>
+#include <cstdint>
+using namespace std;
+
+/**
+ * All Pairs Distances of an unweighted Coupling Graph from one BFS per qubit
+ * Distances and next hops are contiguous uint16_t rows padded to 64-byte
+ * cache lines, so the swap search reads a row with few cache misses
+ */
+class DistanceMatrix {
+  public:
+    explicit DistanceMatrix(const vector<set<int>> &coupling_graph)
+        : num_qubits(coupling_graph.size()),
+          stride((num_qubits + LINE - 1) / LINE * LINE),
+          storage(2 * num_qubits * stride + LINE, 0)
+    {
+        assert(num_qubits < UINT16_MAX);
+
+        // Align the first row to a cache line
+        uintptr_t address = (uintptr_t)storage.data();
+        unsigned int offset = (64 - address % 64) % 64 / sizeof(uint16_t);
+        distances = storage.data() + offset;
+        next_hops = distances + num_qubits * stride;
+
+        // Unreachable qubits are further than any path
+        vector<int> frontier;
+        frontier.reserve(num_qubits);
+        for (int source = 0; source < num_qubits; source++)
+        {
+            uint16_t *distance_row = distances + source * stride;
+            for (int v = 0; v < num_qubits; v++)
+            {
+                distance_row[v] = num_qubits + 1;
+            }
+            distance_row[source] = 0;
+            frontier.clear();
+            frontier.push_back(source);
+            for (unsigned int k = 0; k < frontier.size(); k++)
+            {
+                int u = frontier[k];
+                for (int v : coupling_graph[u])
+                {
+                    if (distance_row[v] > num_qubits)
+                    {
+                        distance_row[v] = distance_row[u] + 1;
+                        frontier.push_back(v);
+                    }
+                }
+            }
+        }
+
+        // Lowest neighbor on a shortest path, the qubit itself if none
+        for (int u = 0; u < num_qubits; u++)
+        {
+            uint16_t *next_row = next_hops + u * stride;
+            for (int v = 0; v < num_qubits; v++)
+            {
+                next_row[v] = u;
+                for (int w : coupling_graph[u])
+                {
+                    if (distance(w, v) + 1 == distance(u, v))
+                    {
+                        next_row[v] = w;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    DistanceMatrix(const DistanceMatrix &) = delete;
+    DistanceMatrix &operator=(const DistanceMatrix &) = delete;
+
+    int size() const { return num_qubits; }
+
+    int distance(int u, int v) const { return distances[u * stride + v]; }
+
+    // Neighbor of u on a shortest path to v
+    int next_hop(int u, int v) const { return next_hops[u * stride + v]; }
+
+    // Distances from u to every qubit
+    const uint16_t *row(int u) const { return distances + u * stride; }
+
+  private:
+    static const int LINE = 64 / sizeof(uint16_t);
+
+    int num_qubits;
+    int stride;
+    vector<uint16_t> storage;
+    uint16_t *distances;
+    uint16_t *next_hops;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef DYNAMICBITSET_HPP
+#define DYNAMICBITSET_HPP
+
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+/**
+ * Bitset sized at runtime, stored as 64-bit words
+ * Set operations on qubit sets are word-wise instead of walking trees
+ */
+class DynamicBitset {
+  public:
+    DynamicBitset() : num_bits(0) {}
+
+    explicit DynamicBitset(int num_bits)
+        : num_bits(num_bits),
+          words((num_bits + 63) / 64, 0) {}
+
+    int size() const { return num_bits; }
+
+    bool operator[](int bit) const { return (words[bit >> 6] >> (bit & 63)) & 1; }
+
+    void set(int bit) { words[bit >> 6] |= (uint64_t)1 << (bit & 63); }
+
+    void reset(int bit) { words[bit >> 6] &= ~((uint64_t)1 << (bit & 63)); }
+
+    void clear()
+    {
+        for (uint64_t &word : words)
+        {
+            word = 0;
+        }
+    }
+
+    int count() const
+    {
+        int total = 0;
+        for (uint64_t word : words)
+        {
+            total += __builtin_popcountll(word);
+        }
+        return total;
+    }
+
+    bool none() const
+    {
+        for (uint64_t word : words)
+        {
+            if (word)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    DynamicBitset &operator&=(const DynamicBitset &other)
+    {
+        for (unsigned int w = 0; w < words.size(); w++)
+        {
+            words[w] &= other.words[w];
+        }
+        return *this;
+    }
+
+    DynamicBitset &operator|=(const DynamicBitset &other)
+    {
+        for (unsigned int w = 0; w < words.size(); w++)
+        {
+            words[w] |= other.words[w];
+        }
+        return *this;
+    }
+
+    // Remove every bit set in other
+    DynamicBitset &subtract(const DynamicBitset &other)
+    {
+        for (unsigned int w = 0; w < words.size(); w++)
+        {
+            words[w] &= ~other.words[w];
+        }
+        return *this;
+    }
+
+    // First set bit, or -1 if none
+    int find_first() const { return find_from(0); }
+
+    // First set bit after bit, or -1 if none
+    int find_next(int bit) const { return find_from(bit + 1); }
+
+    // Append the set bits in increasing order
+    void append_to(vector<int> &bits) const
+    {
+        for (unsigned int w = 0; w < words.size(); w++)
+        {
+            uint64_t word = words[w];
+            while (word)
+            {
+                bits.push_back(w * 64 + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+  private:
+    int num_bits;
+    vector<uint64_t> words;
+
+    int find_from(int bit) const
+    {
+        if (bit >= num_bits)
+        {
+            return -1;
+        }
+        unsigned int w = bit >> 6;
+        uint64_t word = words[w] & (~(uint64_t)0 << (bit & 63));
+        while (!word)
+        {
+            if (++w == words.size())
+            {
+                return -1;
+            }
+            word = words[w];
+        }
+        return w * 64 + __builtin_ctzll(word);
+    }
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef FIXEDBITSET_HPP
+#define FIXEDBITSET_HPP
+
+#include <vector>
+#include <cstdint>
+using namespace std;
+
+/**
+ * Bitset of a compile-time number of 64-bit words, same interface as DynamicBitset
+ * With a single word every set operation is one register instruction
+ */
+template <int WORDS>
+class FixedBitset {
+  public:
+    FixedBitset() : num_bits(0) { clear(); }
+
+    explicit FixedBitset(int num_bits) : num_bits(num_bits) { clear(); }
+
+    int size() const { return num_bits; }
+
+    bool operator[](int bit) const { return (words[bit >> 6] >> (bit & 63)) & 1; }
+
+    void set(int bit) { words[bit >> 6] |= (uint64_t)1 << (bit & 63); }
+
+    void reset(int bit) { words[bit >> 6] &= ~((uint64_t)1 << (bit & 63)); }
+
+    void clear()
+    {
+        for (int w = 0; w < WORDS; w++)
+        {
+            words[w] = 0;
+        }
+    }
+
+    int count() const
+    {
+        int total = 0;
+        for (int w = 0; w < WORDS; w++)
+        {
+            total += __builtin_popcountll(words[w]);
+        }
+        return total;
+    }
+
+    bool none() const
+    {
+        for (int w = 0; w < WORDS; w++)
+        {
+            if (words[w])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    FixedBitset &operator&=(const FixedBitset &other)
+    {
+        for (int w = 0; w < WORDS; w++)
+        {
+            words[w] &= other.words[w];
+        }
+        return *this;
+    }
+
+    FixedBitset &operator|=(const FixedBitset &other)
+    {
+        for (int w = 0; w < WORDS; w++)
+        {
+            words[w] |= other.words[w];
+        }
+        return *this;
+    }
+
+    // Remove every bit set in other
+    FixedBitset &subtract(const FixedBitset &other)
+    {
+        for (int w = 0; w < WORDS; w++)
+        {
+            words[w] &= ~other.words[w];
+        }
+        return *this;
+    }
+
+    // First set bit, or -1 if none
+    int find_first() const { return find_from(0); }
+
+    // First set bit after bit, or -1 if none
+    int find_next(int bit) const { return find_from(bit + 1); }
+
+    // Append the set bits in increasing order
+    void append_to(vector<int> &bits) const
+    {
+        for (int w = 0; w < WORDS; w++)
+        {
+            uint64_t word = words[w];
+            while (word)
+            {
+                bits.push_back(w * 64 + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+  private:
+    int num_bits;
+    uint64_t words[WORDS];
+
+    int find_from(int bit) const
+    {
+        if (bit >= WORDS * 64)
+        {
+            return -1;
+        }
+        int w = bit >> 6;
+        uint64_t word = words[w] & (~(uint64_t)0 << (bit & 63));
+        while (!word)
+        {
+            if (++w == WORDS)
+            {
+                return -1;
+            }
+            word = words[w];
+        }
+        return w * 64 + __builtin_ctzll(word);
+    }
+};
+
+#endif
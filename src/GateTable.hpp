@@ -0,0 +1,112 @@
+#ifndef GATETABLE_HPP
+#define GATETABLE_HPP
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cassert>
+#include <cstdint>
+using namespace std;
+
+/**
+ * Interned Strings, numbered in the order they are first seen
+ */
+class SymbolTable {
+  public:
+    // Symbol of the string, added if new
+    int intern(const string &text)
+    {
+        unordered_map<string, int>::iterator found = index.find(text);
+        if (found != index.end())
+        {
+            return found->second;
+        }
+        int symbol = symbols.size();
+        symbols.push_back(text);
+        index.emplace(text, symbol);
+        return symbol;
+    }
+
+    const string &operator[](int symbol) const { return symbols[symbol]; }
+
+    int size() const { return symbols.size(); }
+
+  private:
+    vector<string> symbols;
+    unordered_map<string, int> index;
+};
+
+/**
+ * Gates of a Circuit in program order as parallel arrays, with the gate
+ * names split into an interned opcode and interned parameters, e.g. "rz"
+ * and "(0.5)" for rz(0.5), so a gate takes 14 bytes instead of a heap node
+ */
+class GateTable {
+  public:
+    vector<uint16_t> opcodes;       // symbol of the name of each gate in opcode_names
+    vector<int> parameters;         // symbol of the parameters of each gate in parameter_texts
+    vector<int> controls;           // control qubit of each gate, or -1
+    vector<int> targets;            // target qubit of each gate
+    SymbolTable opcode_names;       // names before the parameters, e.g. "cx" or "rz"
+    SymbolTable parameter_texts;    // parameters with their parentheses, "" (symbol 0) if none
+
+    GateTable() { parameter_texts.intern(""); }
+
+    int size() const { return targets.size(); }
+
+    // Name of the gate as written in the QASM input
+    string name(int gate) const
+    {
+        return opcode_names[opcodes[gate]] + parameter_texts[parameters[gate]];
+    }
+
+    // Adds a gate named begin to end, parameters included
+    void push_back(const char *begin, const char *end, int control, int target)
+    {
+        const char *parenthesis = begin;
+        while (parenthesis < end && *parenthesis != '(')
+        {
+            parenthesis++;
+        }
+        int opcode = opcode_names.intern(string(begin, parenthesis));
+        assert(opcode <= UINT16_MAX);
+        opcodes.push_back(opcode);
+        parameters.push_back(parenthesis == end ? 0 : parameter_texts.intern(string(parenthesis, end)));
+        controls.push_back(control);
+        targets.push_back(target);
+    }
+
+    // Adds the gates of another table after these, interning its symbols
+    void append(const GateTable &other)
+    {
+        vector<int> opcode_symbols(other.opcode_names.size());
+        for (int symbol = 0; symbol < other.opcode_names.size(); symbol++)
+        {
+            opcode_symbols[symbol] = opcode_names.intern(other.opcode_names[symbol]);
+            assert(opcode_symbols[symbol] <= UINT16_MAX);
+        }
+        vector<int> parameter_symbols(other.parameter_texts.size());
+        for (int symbol = 0; symbol < other.parameter_texts.size(); symbol++)
+        {
+            parameter_symbols[symbol] = parameter_texts.intern(other.parameter_texts[symbol]);
+        }
+
+        for (int gate = 0; gate < other.size(); gate++)
+        {
+            opcodes.push_back(opcode_symbols[other.opcodes[gate]]);
+            parameters.push_back(parameter_symbols[other.parameters[gate]]);
+        }
+        controls.insert(controls.end(), other.controls.begin(), other.controls.end());
+        targets.insert(targets.end(), other.targets.begin(), other.targets.end());
+    }
+
+    void reserve(size_t num_gates)
+    {
+        opcodes.reserve(num_gates);
+        parameters.reserve(num_gates);
+        controls.reserve(num_gates);
+        targets.reserve(num_gates);
+    }
+};
+
+#endif
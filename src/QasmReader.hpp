@@ -0,0 +1,233 @@
+#ifndef QASMREADER_HPP
+#define QASMREADER_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef WINDOWS
+#include <sys/mman.h>
+#endif
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+/**
+ * Bytes of a QASM input, mapped into memory when it is a regular file and
+ * read whole otherwise (pipes, Standard Input, or without mmap), with a
+ * vectorized scan for the number boundaries of the parser
+ */
+class QasmReader {
+  public:
+    // "-" reads Standard Input
+    explicit QasmReader(const string &file_name)
+        : bytes(NULL),
+          length(0),
+          mapped(false),
+          opened(false)
+    {
+        int fd = file_name == "-" ? STDIN_FILENO : open(file_name.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+
+#ifndef WINDOWS
+        struct stat status;
+        if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+        {
+            void *address = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED)
+            {
+                madvise(address, status.st_size, MADV_SEQUENTIAL);
+                bytes = (const char *)address;
+                length = status.st_size;
+                mapped = true;
+                opened = true;
+            }
+        }
+#endif
+
+        // Read whole
+        while (!mapped)
+        {
+            size_t offset = buffer.size();
+            buffer.resize(offset + max((size_t)1 << 16, offset));
+            ssize_t count = read(fd, &buffer[offset], buffer.size() - offset);
+            if (count < 0 && errno == EINTR)
+            {
+                buffer.resize(offset);
+                continue;
+            }
+            buffer.resize(offset + max(count, (ssize_t)0));
+            if (count <= 0)
+            {
+                opened = count == 0;
+                bytes = buffer.data();
+                length = buffer.size();
+                break;
+            }
+        }
+
+        if (fd != STDIN_FILENO)
+        {
+            close(fd);
+        }
+    }
+
+    ~QasmReader()
+    {
+#ifndef WINDOWS
+        if (mapped)
+        {
+            munmap((void *)bytes, length);
+        }
+#endif
+    }
+
+    QasmReader(const QasmReader &) = delete;
+    QasmReader &operator=(const QasmReader &) = delete;
+
+    bool is_open() const { return opened; }
+
+    const char *begin() const { return bytes; }
+
+    const char *end() const { return bytes + length; }
+
+    size_t size() const { return length; }
+
+    // First start of a line at or after p, or end
+    const char *next_line_start(const char *p) const
+    {
+        if (p <= begin())
+        {
+            return begin();
+        }
+        const char *newline = (const char *)memchr(p - 1, '\n', end() - (p - 1));
+        return newline == NULL ? end() : newline + 1;
+    }
+
+    // First byte at or after p that is not a decimal digit, or end
+    static const char *skip_digits(const char *p, const char *end)
+    {
+#if defined(__SSE2__) && defined(__GNUC__)
+        while (end - p >= 16)
+        {
+            // Digits are the bytes in ['0', '9'] as signed bytes
+            __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            __m128i digits = _mm_and_si128(
+                _mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+                _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
+            int mask = ~_mm_movemask_epi8(digits) & 0xFFFF;
+            if (mask != 0)
+            {
+                return p + __builtin_ctz(mask);
+            }
+            p += 16;
+        }
+#endif
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            p++;
+        }
+        return p;
+    }
+
+  private:
+    const char *bytes;
+    size_t length;
+    bool mapped;
+    bool opened;
+    vector<char> buffer;
+};
+
+/**
+ * Lines of a range of QASM bytes, found from a bitmask of the newlines in
+ * every 32 bytes; the range of one chunk of a parallel parse, or all of it
+ */
+class QasmLines {
+  public:
+    QasmLines(const char *begin, const char *end)
+        : position(begin),
+          chunk(begin),
+          end(end),
+          newlines(begin < end ? newline_mask(begin, end) : 0) {}
+
+    // Next line without its newline, false after the last line
+    bool next_line(const char *&line, const char *&line_end)
+    {
+        if (position >= end)
+        {
+            return false;
+        }
+        line = position;
+
+        // Newlines of the next 32 bytes as bits
+        while (newlines == 0)
+        {
+            chunk += 32;
+            if (chunk >= end)
+            {
+                line_end = end;
+                position = end;
+                return true;
+            }
+            newlines = newline_mask(chunk, end);
+        }
+
+        line_end = chunk + __builtin_ctz(newlines);
+        newlines &= newlines - 1;
+        position = line_end + 1;
+        return true;
+    }
+
+  private:
+    // The line after the last one returned, and the newlines after it in
+    // the 32 bytes from chunk
+    const char *position;
+    const char *chunk;
+    const char *end;
+    unsigned int newlines;
+
+    static unsigned int newline_mask(const char *p, const char *end)
+    {
+#if defined(__SSE2__) && defined(__GNUC__)
+        if (end - p >= 32)
+        {
+            static const bool avx2 = __builtin_cpu_supports("avx2");
+            if (avx2)
+            {
+                return newline_mask_avx2(p);
+            }
+            __m128i newline = _mm_set1_epi8('\n');
+            unsigned int low = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), newline));
+            unsigned int high = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), newline));
+            return low | high << 16;
+        }
+#endif
+        unsigned int mask = 0;
+        for (int i = 0; i < 32 && p + i < end; i++)
+        {
+            if (p[i] == '\n')
+            {
+                mask |= 1U << i;
+            }
+        }
+        return mask;
+    }
+
+#if defined(__SSE2__) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    static unsigned int newline_mask_avx2(const char *p)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')));
+    }
+#endif
+};
+
+#endif
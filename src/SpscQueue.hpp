@@ -0,0 +1,77 @@
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <vector>
+#include <atomic>
+#include <thread>
+using namespace std;
+
+/**
+ * Lock-free ring buffer between one producer thread and one consumer thread
+ * Each side owns one index and publishes it with release stores, so an
+ * element is fully written before the other side can see it; the indices
+ * sit on separate cache lines
+ */
+template <typename T>
+class SpscQueue {
+  public:
+    // Capacity is rounded up to a power of two
+    explicit SpscQueue(unsigned int capacity)
+        : slots(round_up(capacity)),
+          mask(slots.size() - 1),
+          head(0),
+          tail(0),
+          closed(false) {}
+
+    // Wait while the queue is full
+    void push(const T &element)
+    {
+        unsigned int position = tail.load(memory_order_relaxed);
+        while (position - head.load(memory_order_acquire) == slots.size())
+        {
+            this_thread::yield();
+        }
+        slots[position & mask] = element;
+        tail.store(position + 1, memory_order_release);
+    }
+
+    // No element follows
+    void close() { closed.store(true, memory_order_release); }
+
+    // Wait for an element, false once the queue is closed and drained
+    bool pop(T &element)
+    {
+        unsigned int position = head.load(memory_order_relaxed);
+        while (position == tail.load(memory_order_acquire))
+        {
+            if (closed.load(memory_order_acquire) &&
+                position == tail.load(memory_order_acquire))
+            {
+                return false;
+            }
+            this_thread::yield();
+        }
+        element = slots[position & mask];
+        head.store(position + 1, memory_order_release);
+        return true;
+    }
+
+  private:
+    vector<T> slots;
+    unsigned int mask;
+    alignas(64) atomic<unsigned int> head;  // next element to pop, written by the consumer
+    alignas(64) atomic<unsigned int> tail;  // next slot to push, written by the producer
+    atomic<bool> closed;
+
+    static unsigned int round_up(unsigned int capacity)
+    {
+        unsigned int size = 1;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        return size;
+    }
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef SWAPCACHE_HPP
+#define SWAPCACHE_HPP
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <string>
+#include <fstream>
+#include <cstdio>
+using namespace std;
+
+/**
+ * Least Recently Used Cache of Swap Blocks keyed by the relative permutation
+ * of a transition: the destination of the token on each physical qubit, or
+ * -1 if empty, so transitions moving the same physical qubits share an entry
+ * whichever logical qubits they carry
+ */
+class SwapCache {
+  public:
+    SwapCache(unsigned int capacity, unsigned long long coupling_hash)
+        : capacity(capacity),
+          coupling_hash(coupling_hash) {}
+
+    SwapCache(const SwapCache &) = delete;
+    SwapCache &operator=(const SwapCache &) = delete;
+
+    // Swaps of the permutation, NULL if not cached
+    const vector<pair<int, int>> *find(const vector<int> &permutation)
+    {
+        unordered_map<vector<int>, Entries::iterator, PermutationHash>::iterator found =
+            index.find(permutation);
+        if (found == index.end())
+        {
+            return NULL;
+        }
+        entries.splice(entries.begin(), entries, found->second);
+        return &found->second->second;
+    }
+
+    // Evicts the least recently used entry when full
+    void insert(const vector<int> &permutation, const vector<pair<int, int>> &swaps)
+    {
+        unordered_map<vector<int>, Entries::iterator, PermutationHash>::iterator found =
+            index.find(permutation);
+        if (found != index.end())
+        {
+            found->second->second = swaps;
+            entries.splice(entries.begin(), entries, found->second);
+            return;
+        }
+        if (capacity == 0)
+        {
+            return;
+        }
+        if (index.size() == capacity)
+        {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.push_front(make_pair(permutation, swaps));
+        index[permutation] = entries.begin();
+    }
+
+    // Entries of a previous run on the same coupling, skipped if the file
+    // is missing or was written for another coupling
+    void load(const string &file_name)
+    {
+        ifstream file(file_name);
+        string tag;
+        unsigned long long file_hash;
+        unsigned int num_entries;
+        if (!(file >> tag >> file_hash >> num_entries) ||
+            tag != "swap-cache" || file_hash != coupling_hash)
+        {
+            return;
+        }
+
+        // Least recently used first
+        for (unsigned int entry = 0; entry < num_entries; entry++)
+        {
+            unsigned int num_qubits, num_swaps;
+            if (!(file >> num_qubits))
+            {
+                return;
+            }
+            vector<int> permutation(num_qubits);
+            for (int &destination : permutation)
+            {
+                file >> destination;
+            }
+            if (!(file >> num_swaps))
+            {
+                return;
+            }
+            vector<pair<int, int>> swaps(num_swaps);
+            for (pair<int, int> &swap_gate : swaps)
+            {
+                file >> swap_gate.first >> swap_gate.second;
+            }
+            if (!file)
+            {
+                return;
+            }
+            insert(permutation, swaps);
+        }
+    }
+
+    // Replaces the file at once, so concurrent runs never read half of it
+    bool save(const string &file_name) const
+    {
+        string temp_file_name = file_name + ".tmp";
+        {
+            ofstream file(temp_file_name);
+            file << "swap-cache " << coupling_hash << " " << entries.size() << "\n";
+            for (Entries::const_reverse_iterator entry = entries.rbegin(); entry != entries.rend(); entry++)
+            {
+                file << entry->first.size();
+                for (int destination : entry->first)
+                {
+                    file << " " << destination;
+                }
+                file << " " << entry->second.size();
+                for (const pair<int, int> &swap_gate : entry->second)
+                {
+                    file << " " << swap_gate.first << " " << swap_gate.second;
+                }
+                file << "\n";
+            }
+            if (!file)
+            {
+                return false;
+            }
+        }
+        return rename(temp_file_name.c_str(), file_name.c_str()) == 0;
+    }
+
+  private:
+    // FNV-1a over the destinations
+    struct PermutationHash
+    {
+        size_t operator()(const vector<int> &permutation) const
+        {
+            unsigned long long hash = 14695981039346656037ULL;
+            for (int destination : permutation)
+            {
+                hash = (hash ^ (unsigned int)destination) * 1099511628211ULL;
+            }
+            return hash;
+        }
+    };
+
+    // Most recently used first
+    typedef list<pair<vector<int>, vector<pair<int, int>>>> Entries;
+
+    unsigned int capacity;
+    unsigned long long coupling_hash;
+    Entries entries;
+    unordered_map<vector<int>, Entries::iterator, PermutationHash> index;
+};
+
+#endif
@@ -1,198 +1,301 @@
-#include "GateNode.hpp"
+#include "GateTable.hpp"
 #include "QASMparser.h"
+#include "QasmReader.hpp"
 #include <cassert>
 #include <cstring>
 #include <iostream>
 #include <utility>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
 #include <ctype.h>
 using namespace std;
 
+static bool
+starts_with(const char *begin, const char *end, const char *prefix)
+{
+	size_t length = strlen(prefix);
+	return (size_t)(end - begin) >= length && memcmp(begin, prefix, length) == 0;
+}
+
+// Value of the digit run at begin, and the byte after it
 static int
-parse_max_qubits(string line)
+parse_number(const char *begin, const char *end, const char *&after)
 {
-	string max_qubits_string = "";
-	bool found = false;
-	for (char c : line)
+	after = QasmReader::skip_digits(begin, end);
+	assert(after > begin);
+	int value = 0;
+	for (const char *p = begin; p < after; p++)
 	{
-		if (isdigit(c))
-		{
-			found = true;
-			max_qubits_string += c;
-		}
-		else if (found == true)
-		{
-			break;
-		}
+		value = value * 10 + (*p - '0');
 	}
-
-	return stoi(max_qubits_string);
+	return value;
 }
 
-static GateNode*
-parse_gate(string line, set<int> &seen)
+static int
+parse_max_qubits(const char *begin, const char *end)
 {
-	// GateNode Members
-	GateNode * v = new GateNode;
-	v->name = "";
-	v->control = UNDEFINED_QUBIT;
-	v->target = UNDEFINED_QUBIT;
-	v->controlChild = 0;
-	v->targetChild = 0;
-	v->controlParent = 0;
-	v->targetParent = 0;
-
-	unsigned int i = 0;
-
-	// Parse Name
-	for (; i < line.length(); i++)
+	while (begin < end && !isdigit(*begin))
 	{
-		char c = line[i];
-		if (isspace(c))
-		{
-			break;
-		}
-		v->name += c;
+		begin++;
 	}
+	const char *after;
+	return parse_number(begin, end, after);
+}
+
+// Qubit index inside the next brackets, and the byte after the ']'
+static int
+parse_argument(const char *begin, const char *end, const char *&after)
+{
+	const char *bracket = (const char *)memchr(begin, '[', end - begin);
+	assert(bracket != NULL);
+	int qubit = parse_number(bracket + 1, end, after);
+	assert(after < end && *after == ']');
+	after++;
+	return qubit;
+}
 
-	// Ignore Whitespace
-	while (isspace(line[i]))
+static void
+parse_gate(const char *begin, const char *end, set<int> &seen, GateTable &gates)
+{
+	// Parse Name
+	const char *i = begin;
+	while (i < end && !isspace(*i))
 	{
 		i++;
 	}
+	const char *name_end = i;
 
 	// Parse First Argument
-	string first_arg_string = "";
-	for (; i < line.length(); i++)
-	{
-		char c = line[i];
-		if (isdigit(c))
-		{
-			first_arg_string += c;
-		}
-		else if (c == ']')
-		{
-			i++;
-			break;
-		}
-	}
-	int first_arg = stoi(first_arg_string);
+	int first_arg = parse_argument(i, end, i);
 	seen.insert(first_arg);
 
 	// If no second argument, set target and return
-	if (line[i] != ',')
-	{
-		v->target = first_arg;
-		return v;
-	}
-
-	// Otherwise, set control
-	v->control = first_arg;
-
-	// Ignore Whitespace
-	while (isspace(line[i]) || line[i] == ',')
+	if (i == end || *i != ',')
 	{
-		i++;
+		gates.push_back(begin, name_end, UNDEFINED_QUBIT, first_arg);
+		return;
 	}
 
 	// Parse Second Argument
-	string second_arg_string = "";
-	for (; i < line.length(); i++)
-	{
-		char c = line[i];
-		if (isdigit(c))
-		{
-			second_arg_string += c;
-		}
-		else if (c == ']')
-		{
-			break;
-		}
-	}
-	int second_arg = stoi(second_arg_string);
-	v->target = second_arg;
+	int second_arg = parse_argument(i, end, i);
 	seen.insert(second_arg);
 
-	assert(v->control != v->target);
+	assert(first_arg != second_arg);
 
-	return v;
+	gates.push_back(begin, name_end, first_arg, second_arg);
 }
 
-pair<vector<vector<int>>, vector<GateNode*>>
-preprocess_circuit(string qasmFileName, int &num_logical_qubits) {
+// Circuit read in a single pass over the QASM input
+struct Circuit
+{
+	vector<string> header;				// lines before the first gate
+	int num_qubits;						// size of the quantum register
+	GateTable gates;					// gates in program order
+	vector<vector<int>> live_ranges;	// gate indices of each pair of logical qubits
+	size_t num_bytes;					// bytes of the QASM input
+	double seconds;						// time reading the QASM input
+};
 
-	// Gates
-	vector<GateNode*> gates_circuit;
+// Lines of the QASM input parsed by one thread, merged in order
+struct CircuitChunk
+{
+	vector<string> header;				// lines before the first gate of the chunk
+	int num_qubits;						// size of the last quantum register, -1 if none
+	GateTable gates;					// gates in program order
+	set<int> seen;						// qubits of the gates
+};
 
-	// Qubits
-	set<int> seen;
+// Bytes of the QASM input per parsing thread below which fewer threads parse
+const size_t MIN_CHUNK_BYTES = 1 << 20;
 
-	// Max Qubits
-	int max_qubits = 0;
+/**
+ * Parse the whole lines of a range of the QASM input
+ * @param begin Input: first byte, at the start of a line
+ * @param end Input: byte after the last line
+ * @param chunk Output: header lines, register size, gates and qubits of the range
+ */
+static void
+parse_chunk(const char *begin,
+			const char *end,
+			CircuitChunk &chunk)
+{
+	chunk.num_qubits = -1;
+	QasmLines lines(begin, end);
+	const char *line;
+	const char *line_end;
+	while (lines.next_line(line, line_end))
+	{
+		// Lines to Ignore, kept in the Header before the first Gate
+		if (starts_with(line, line_end, "OPENQASM") ||
+			starts_with(line, line_end, "include") ||
+			starts_with(line, line_end, "creg") ||
+			starts_with(line, line_end, "//"))
+		{
+			if (chunk.gates.size() == 0)
+			{
+				chunk.header.push_back(string(line, line_end));
+			}
+		}
+		else if (line == line_end)
+		{
+			continue;
+		}
+		// Max Qubits
+		else if (starts_with(line, line_end, "qreg"))
+		{
+			chunk.num_qubits = parse_max_qubits(line, line_end);
+			if (chunk.gates.size() == 0)
+			{
+				chunk.header.push_back(string(line, line_end));
+			}
+		}
+		// Gate
+		else
+		{
+			parse_gate(line, line_end, chunk.seen, chunk.gates);
+		}
+	}
+}
 
-	// Parse QASM File
-	fstream qasmFile;
-	qasmFile.open(qasmFileName, ios::in);
-	if (qasmFile.is_open())
+/**
+ * Add the gates of the logical qubits a thread owns to their live ranges,
+ * the rows of the qubits equal to the thread index modulo the threads
+ * @param gates Input: gates in program order
+ * @param num_logical_qubits Input: number of logical qubits
+ * @param thread_index Input: thread adding the gates
+ * @param num_threads Input: threads adding the gates
+ * @param live_ranges Output: gate indices of each pair of logical qubits
+ */
+static void
+add_live_ranges(const GateTable &gates,
+				int num_logical_qubits,
+				int thread_index,
+				int num_threads,
+				vector<vector<int>> &live_ranges)
+{
+	for (int i = 0; i < gates.size(); i++)
 	{
-		string line;
-		while (getline(qasmFile, line))
+		int control = gates.controls[i];
+		int target = gates.targets[i];
+
+		// If gate is single
+		if (control == UNDEFINED_QUBIT)
 		{
-			// Lines to Ignore
-			if (line.rfind("OPENQASM", 0) == 0 ||
-				line.rfind("include", 0) == 0 ||
-				line.rfind("creg", 0) == 0 ||
-				line.rfind("//", 0) == 0 ||
-				line.length() == 0)
+			if (target % num_threads == thread_index)
 			{
-				continue;
+				live_ranges[target * num_logical_qubits + target].push_back(i);
 			}
-			// Max Qubits
-			else if (line.rfind("qreg", 0) == 0)
+		}
+		// If gate is double
+		else
+		{
+			if (control % num_threads == thread_index)
 			{
-				max_qubits = parse_max_qubits(line);
+				live_ranges[control * num_logical_qubits + target].push_back(i);
 			}
-			// Gate
-			else
+			if (target % num_threads == thread_index)
 			{
-				gates_circuit.push_back(parse_gate(line, seen));
+				live_ranges[target * num_logical_qubits + control].push_back(i);
 			}
 		}
-		qasmFile.close();
-
-		// Set Number of Qubits
-		num_logical_qubits = seen.size();
 	}
-	else
+}
+
+Circuit
+preprocess_circuit(string qasmFileName, int &num_logical_qubits, int num_threads) {
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	Circuit circuit;
+
+	// Parse QASM File, or Standard Input if "-"
+	QasmReader qasm(qasmFileName);
+	if (!qasm.is_open())
 	{
 		cerr << "Error opening file \"" << qasmFileName << "\"" << endl;
 		exit(1);
 	}
+	circuit.num_bytes = qasm.size();
 
-	// Live Ranges with 2D Matrix Access: Row * Number of Qubits + Col
-	vector<vector<int>> live_ranges(num_logical_qubits * num_logical_qubits);
-
-	for (int i = 0; i < (int)gates_circuit.size(); i++)
+	// Chunks of at least MIN_CHUNK_BYTES split at line starts, one per thread
+	int num_chunks = max(1, (int)min((size_t)num_threads, qasm.size() / MIN_CHUNK_BYTES));
+	vector<const char *> bounds(num_chunks + 1);
+	for (int c = 0; c <= num_chunks; c++)
+	{
+		bounds[c] = qasm.next_line_start(qasm.begin() + qasm.size() * c / num_chunks);
+	}
+	vector<CircuitChunk> chunks(num_chunks);
+	vector<thread> threads;
+	for (int c = 1; c < num_chunks; c++)
 	{
-		GateNode* v = gates_circuit[i];
+		threads.push_back(thread(parse_chunk, bounds[c], bounds[c + 1], ref(chunks[c])));
+	}
+	parse_chunk(bounds[0], bounds[1], chunks[0]);
+	for (thread &worker : threads)
+	{
+		worker.join();
+	}
 
-		// If gate is single
-		if (v->control == UNDEFINED_QUBIT)
-        {
-			live_ranges[v->target * num_logical_qubits + v->target].push_back(i);
-        }
-        // If gate is double
+	// Merge in order: Header until the first Gate, and the last Max Qubits
+	size_t num_gates = 0;
+	for (CircuitChunk &chunk : chunks)
+	{
+		num_gates += chunk.gates.size();
+	}
+	if (num_chunks > 1)
+	{
+		circuit.gates.reserve(num_gates);
+	}
+	circuit.num_qubits = 0;
+	set<int> seen;
+	for (CircuitChunk &chunk : chunks)
+	{
+		if (circuit.gates.size() == 0)
+		{
+			circuit.header.insert(circuit.header.end(), chunk.header.begin(), chunk.header.end());
+		}
+		if (chunk.num_qubits != -1)
+		{
+			circuit.num_qubits = chunk.num_qubits;
+		}
+		// A single Chunk is the whole Circuit, others are freed once copied
+		if (num_chunks == 1)
+		{
+			circuit.gates = move(chunk.gates);
+		}
 		else
 		{
-			live_ranges[v->control * num_logical_qubits + v->target].push_back(i);
-			live_ranges[v->target * num_logical_qubits + v->control].push_back(i);
+			circuit.gates.append(chunk.gates);
+			chunk.gates = GateTable();
 		}
+		seen.insert(chunk.seen.begin(), chunk.seen.end());
+	}
+
+	// Set Number of Qubits
+	num_logical_qubits = seen.size();
+
+	// Live Ranges with 2D Matrix Access: Row * Number of Qubits + Col
+	vector<vector<int>> &live_ranges = circuit.live_ranges;
+	live_ranges.resize(num_logical_qubits * num_logical_qubits);
+
+	// Rows of the Live Ranges split over the same threads
+	int num_row_threads = max(1, min(num_chunks, num_logical_qubits));
+	threads.clear();
+	for (int t = 1; t < num_row_threads; t++)
+	{
+		threads.push_back(thread(add_live_ranges, cref(circuit.gates), num_logical_qubits, t, num_row_threads, ref(live_ranges)));
+	}
+	add_live_ranges(circuit.gates, num_logical_qubits, 0, num_row_threads, live_ranges);
+	for (thread &worker : threads)
+	{
+		worker.join();
 	}
 
-	assert(num_logical_qubits <= max_qubits);
+	assert(num_logical_qubits <= circuit.num_qubits);
 
-	return pair<vector<vector<int>>, vector<GateNode*>>(
-		live_ranges,
-		gates_circuit);
+	circuit.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return circuit;
 }
 
 
@@ -1,172 +1,317 @@
-#include "GateNode.hpp"
+#include "GateTable.hpp"
 #include "QASMparser.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <utility>
+#include <map>
+#include <algorithm>
 #include <cstdio>
 #include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
+#include "CircuitWriter.hpp"
 using namespace std;
 
-string compile_circuit(
-    string qasmFileName,
-    vector<pair<pair<int, int>, vector<int>>> &mappings,
-    vector<vector<pair<int, int>>> &swaps,
-    vector<GateNode*> &gates_circuit,
-    set<pair<int, int>> &couplings,
-    int num_physical_qubits)
+// U and CX Gates of the one and two qubit gates of qelib1.inc, in the order
+// QASMparser expands them: one argument index is a U gate on that argument
+// and two are a CX gate between them
+static const map<string, vector<vector<int>>> QELIB1_GATES = {
+    {"U", {{0}}},
+    {"CX", {{0, 1}}},
+    {"u3", {{0}}},
+    {"u2", {{0}}},
+    {"u1", {{0}}},
+    {"cx", {{0, 1}}},
+    {"id", {{0}}},
+    {"x", {{0}}},
+    {"y", {{0}}},
+    {"z", {{0}}},
+    {"h", {{0}}},
+    {"s", {{0}}},
+    {"sdg", {{0}}},
+    {"t", {{0}}},
+    {"tdg", {{0}}},
+    {"rx", {{0}}},
+    {"ry", {{0}}},
+    {"rz", {{0}}},
+    {"cz", {{1}, {0, 1}, {1}}},
+    {"cy", {{1}, {0, 1}, {1}}},
+    {"ch", {{1}, {1}, {0, 1}, {1}, {1}, {0, 1}, {1}, {1}, {1}, {1}, {0}}},
+    {"crz", {{1}, {0, 1}, {1}, {0, 1}}},
+    {"cu1", {{0}, {0, 1}, {1}, {0, 1}, {1}}},
+    {"cu3", {{1}, {0, 1}, {1}, {0, 1}, {1}}},
+    {"swp", {{0, 1}, {1, 0}, {0, 1}}}
+};
+
+/**
+ * Add a Gate to the Metadata of the compiled Circuit, each of its U and CX
+ * gates in the layer after the last layer of its qubits (ASAP)
+ * @param expansion Input: U and CX Gates of the Gate in QELIB1_GATES
+ * @param arguments Input: Physical Qubits of the Gate
+ * @param last_layer Input/Output: Last Layer of each Physical Qubit, -1 if none
+ * @param depth Input/Output: Number of Layers
+ * @param num_gates Input/Output: Number of U and CX Gates
+ */
+static void
+count_gate(
+    const vector<vector<int>> &expansion,
+    const int arguments[2],
+    vector<int> &last_layer,
+    int &depth,
+    int &num_gates)
 {
-    string circuit = "";
+    for (const vector<int> &primitive : expansion)
+    {
+        int layer = 0;
+        for (int argument : primitive)
+        {
+            layer = max(layer, last_layer[arguments[argument]] + 1);
+        }
+        for (int argument : primitive)
+        {
+            last_layer[arguments[argument]] = layer;
+        }
+        depth = max(depth, layer + 1);
+        num_gates++;
+    }
+}
 
-    // Read Header of QASM File
+/**
+ * Write the Header of the QASM input, with the Quantum Register resized
+ * @param output Output: Writer of the compiled Circuit
+ * @param header Input: Lines before the first Gate
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ */
+static void
+write_header(
+    CircuitWriter &output,
+    vector<string> &header,
+    int num_physical_qubits)
+{
+    for (string &line : header)
     {
-        fstream qasmFile;
-        qasmFile.open(qasmFileName, ios::in);
-        if (qasmFile.is_open()){
-            string line;
-            while (getline(qasmFile, line)){
-                if (line.rfind("OPENQASM", 0) == 0 ||
-                    line.rfind("include", 0) == 0 ||
-                    line.rfind("creg", 0) == 0 ||
-                    line.rfind("//", 0) == 0)
-                {
-                    circuit += line + "\n";
-                }
-                else if (line.rfind("qreg", 0) == 0)
-                {
-                    circuit += "qreg q[" + to_string(num_physical_qubits) + "];\n";
-                }
-                else if (line.length() == 0)
-                {
-                    continue;
-                }
-                else
-                {
-                    break;
-                }
-            }
-            qasmFile.close(); //close the file object.
+        if (line.rfind("qreg", 0) == 0)
+        {
+            output << "qreg q[" << num_physical_qubits << "];\n";
         }
         else
         {
-            cerr << "Error opening file \"" << qasmFileName << "\"" << endl;
-            exit(1);
+            output << line << "\n";
         }
     }
+}
 
-    // Compile Circuit
+/**
+ * Write the Gates and Swaps of every Mapping
+ * @param output Output: Writer of the compiled Circuit
+ * @param mappings Input: Mappings with the gate range each one satisfies
+ * @param swaps Input: Swaps between consecutive Mappings
+ * @param gates_circuit Input: Gates of the Circuit
+ * @param couplings Input: Coupling Graph Edges
+ */
+static void
+write_gates(
+    CircuitWriter &output,
+    vector<pair<pair<int, int>, vector<int>>> &mappings,
+    vector<vector<pair<int, int>>> &swaps,
+    const GateTable &gates_circuit,
+    set<pair<int, int>> &couplings)
+{
+    // Iterate Mappings
+    for (unsigned int mappings_index = 0; mappings_index < mappings.size(); mappings_index++)
     {
-        // Iterate Mappings
-        for (unsigned int mappings_index = 0; mappings_index < mappings.size(); mappings_index++)
+        // Write Initial Mapping Comment
+        vector<int> &initial_mapping = mappings[mappings_index].second;
+        output << "//Location of qubits: ";
+        for (unsigned int logical_qubit = 0; logical_qubit < initial_mapping.size(); logical_qubit++)
+        {
+            output << initial_mapping[logical_qubit];
+            if (logical_qubit != initial_mapping.size() - 1) {
+                output << ",";
+            }
+        }
+        output << "\n";
+
+        // Write Gates up to Upper Bound
+        int lower_bound = mappings[mappings_index].first.first;
+        int upper_bound = mappings[mappings_index].first.second;
+        for (int gate_index = lower_bound; gate_index < upper_bound; gate_index++)
         {
-            // Write Initial Mapping Comment
-            vector<int> initial_mapping = mappings[mappings_index].second;
-            circuit += "//Location of qubits: ";
-            for (unsigned int logical_qubit = 0; logical_qubit < initial_mapping.size(); logical_qubit++)
+            output << gates_circuit.opcode_names[gates_circuit.opcodes[gate_index]]
+                   << gates_circuit.parameter_texts[gates_circuit.parameters[gate_index]] << " ";
+            // If gate is single
+            if (gates_circuit.controls[gate_index] == UNDEFINED_QUBIT)
             {
-                circuit += to_string(initial_mapping[logical_qubit]);
-                if (logical_qubit != initial_mapping.size() - 1) {
-                    circuit +=  ",";
-                }
+                output << "q[" << initial_mapping[gates_circuit.targets[gate_index]] << "]";
             }
-            circuit += "\n";
+            // If gate is double
+            else
+            {
+                int control = initial_mapping[gates_circuit.controls[gate_index]];
+                int target = initial_mapping[gates_circuit.targets[gate_index]];
+                assert(control != target);
+                pair<int, int> edge = control < target
+                    ? pair<int, int>(control, target)
+                    : pair<int, int>(target, control);
+                assert(couplings.find(edge) != couplings.end());
+                output << "q[" << control << "], q[" << target << "]";
+            }
+            output << ";\n";
+        }
+
+        // Insert swaps if not the last mapping
+        if (mappings_index < mappings.size() - 1)
+        {
+            vector<pair<int, int>> &swap_gates = swaps[mappings_index];
+            output << "//Insert " << swap_gates.size() << " Swap Gates\n";
+            for (pair<int, int> &swap_gate : swap_gates)
+            {
+                // SWAP Gate
+                output << "swp q[" << swap_gate.first << "], q[" << swap_gate.second << "];\n";
+            }
+        }
+    }
+}
+
+/**
+ * Compile the Circuit with its Mappings and Swaps, streamed to a file
+ * descriptor after the Metadata Comments
+ * @param qasmFileName Input: QASM File of the Circuit, "-" if Standard Input
+ * @param circuit Input: Header and Gates of the Circuit
+ * @param mappings Input: Mappings with the gate range each one satisfies
+ * @param swaps Input: Swaps between consecutive Mappings
+ * @param couplings Input: Coupling Graph Edges
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ * @param verify Input: Check the Metadata against QASMparser
+ * @param output_fd Output: File descriptor of the compiled Circuit
+ */
+void compile_circuit(
+    string qasmFileName,
+    Circuit &circuit,
+    vector<pair<pair<int, int>, vector<int>>> &mappings,
+    vector<vector<pair<int, int>>> &swaps,
+    set<pair<int, int>> &couplings,
+    int num_physical_qubits,
+    bool verify,
+    int output_fd)
+{
+    GateTable &gates_circuit = circuit.gates;
 
-            // Write Gates up to Upper Bound
+    // U and CX Gates of each Opcode, NULL if undefined
+    vector<const vector<vector<int>> *> expansions(gates_circuit.opcode_names.size(), NULL);
+    for (int opcode = 0; opcode < gates_circuit.opcode_names.size(); opcode++)
+    {
+        map<string, vector<vector<int>>>::const_iterator expansion =
+            QELIB1_GATES.find(gates_circuit.opcode_names[opcode]);
+        if (expansion != QELIB1_GATES.end())
+        {
+            expansions[opcode] = &expansion->second;
+        }
+    }
+
+    // Analyze Circuit
+    int number_of_swaps = 0;
+    int number_of_mappings = mappings.size();
+    int depth = 0;
+    int num_gates = 0;
+    {
+        vector<int> last_layer(num_physical_qubits, -1);
+        for (unsigned int mappings_index = 0; mappings_index < mappings.size(); mappings_index++)
+        {
+            vector<int> &initial_mapping = mappings[mappings_index].second;
             int lower_bound = mappings[mappings_index].first.first;
             int upper_bound = mappings[mappings_index].first.second;
             for (int gate_index = lower_bound; gate_index < upper_bound; gate_index++)
             {
-                GateNode* gate = gates_circuit[gate_index];
-                circuit += gate->name + " ";
-                // If gate is single
-                if (gate->control == UNDEFINED_QUBIT)
+                const vector<vector<int>> *expansion = expansions[gates_circuit.opcodes[gate_index]];
+                if (expansion == NULL)
                 {
-                    circuit += "q[" + to_string(initial_mapping[gate->target]) + "]";
+                    // QASMparser skips undefined gates too
+                    cerr << "Undefined gate: " << gates_circuit.name(gate_index) << endl;
+                    continue;
                 }
-                // If gate is double
-                else
+                int arguments[2] = {initial_mapping[gates_circuit.targets[gate_index]], UNDEFINED_QUBIT};
+                if (gates_circuit.controls[gate_index] != UNDEFINED_QUBIT)
                 {
-                    int control = initial_mapping[gate->control];
-                    int target = initial_mapping[gate->target];
-                    assert(control != target);
-                    pair<int, int> edge = control < target
-                        ? pair<int, int>(control, target)
-                        : pair<int, int>(target, control);
-                    assert(couplings.find(edge) != couplings.end());
-                    circuit +=
-                        "q[" + to_string(control) + "], " +
-                        "q[" + to_string(target) + "]";
+                    arguments[0] = initial_mapping[gates_circuit.controls[gate_index]];
+                    arguments[1] = initial_mapping[gates_circuit.targets[gate_index]];
                 }
-                circuit += ";\n";
+                count_gate(*expansion, arguments, last_layer, depth, num_gates);
             }
 
-            // Insert swaps if not the last mapping
             if (mappings_index < mappings.size() - 1)
             {
-                vector<pair<int, int>> swap_gates = swaps[mappings_index];
-                circuit += "//Insert " + to_string(swap_gates.size()) + " Swap Gates\n";
-                for (pair<int, int> swap_gate : swap_gates)
+                number_of_swaps += swaps[mappings_index].size();
+                for (pair<int, int> &swap_gate : swaps[mappings_index])
                 {
-                    // SWAP Gate
-                    string control = to_string(swap_gate.first);
-                    string target = to_string(swap_gate.second);
-                    circuit += "swp ";
-                    circuit += "q[" + control + "]";
-                    circuit += ", ";
-                    circuit += "q[" + target + "];\n";
+                    int arguments[2] = {swap_gate.first, swap_gate.second};
+                    count_gate(QELIB1_GATES.at("swp"), arguments, last_layer, depth, num_gates);
                 }
             }
         }
     }
 
-    // Analyze Circuit
+    // Output Circuit
     {
-         // Metadata
-        int number_of_swaps = 0;
-        for (auto swap_gates : swaps)
+        CircuitWriter output(output_fd);
+
+        // Add Metadata Comments
+        // - Number of Swaps
+        // - Number of Mappings
+        // - Depth
+        // - Number of Gates
+        output << "//Number of Swaps: " << number_of_swaps << "\n";
+        output << "//Number of Mappings: " << number_of_mappings << "\n";
+        output << "//Depth: " << depth << "\n";
+        output << "//Number of Gates: " << num_gates << "\n";
+
+        write_header(output, circuit.header, num_physical_qubits);
+        write_gates(output, mappings, swaps, gates_circuit, couplings);
+        if (!output.flush())
         {
-            number_of_swaps += swap_gates.size();
+            cerr << "Error writing the compiled circuit" << endl;
+            exit(1);
         }
-        int number_of_mappings = mappings.size();
-        int depth = 0; // See Parser
-        int num_gates = 0; // See Parser
+    }
 
+    // Check the Metadata by parsing the compiled Circuit again
+    if (verify)
+    {
         // Make Temporary File
-        string temp_file_name = qasmFileName + ".XXXXXX";
-        ofstream temp_file(temp_file_name);
-
-        // Write Circuit to the file
-        temp_file << circuit;
-
-        // Close the file
-        temp_file.close();
+        string temp_file_name = (qasmFileName == "-" ? "stdin" : qasmFileName) + ".XXXXXX";
+        int temp_fd = open(temp_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (temp_fd < 0)
+        {
+            cerr << "Error opening file \"" << temp_file_name << "\"" << endl;
+            exit(1);
+        }
+        {
+            CircuitWriter output(temp_fd);
+            write_header(output, circuit.header, num_physical_qubits);
+            write_gates(output, mappings, swaps, gates_circuit, couplings);
+        }
+        close(temp_fd);
 
         // Parse Circuit with QASMparser
         QASMparser* parser = new QASMparser(temp_file_name);
         parser->Parse();
         vector<vector<QASMparser::gate>> layers = parser->getLayers();
-        depth = layers.size();
-        for (auto layer : layers)
+        int parsed_gates = 0;
+        for (auto &layer : layers)
         {
-            num_gates += layer.size();
+            parsed_gates += layer.size();
         }
         delete parser;
 
         // Delete Temporary File
         remove(&temp_file_name[0]);
 
-        // Add Metadata Comments
-        // - Number of Swaps
-        // - Number of Mappings
-        // - Depth
-        // - Number of Gates
-        circuit =
-            "//Number of Swaps: " + to_string(number_of_swaps) + "\n" +
-            "//Number of Mappings: " + to_string(number_of_mappings) + "\n" +
-            "//Depth: " + to_string(depth) + "\n" +
-            "//Number of Gates: " + to_string(num_gates) + "\n" +
-            circuit;
+        if ((int)layers.size() != depth || parsed_gates != num_gates)
+        {
+            cerr << "Metadata mismatch: depth " << depth << " != " << layers.size()
+                 << " or gates " << num_gates << " != " << parsed_gates << endl;
+            exit(1);
+        }
     }
-
-    return circuit;
 }
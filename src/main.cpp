@@ -1,4 +1,4 @@
-#include "GateNode.hpp"
+#include "GateTable.hpp"
 #include "QASMparser.h"
 #include "util.cpp"
 #include <cassert>
@@ -6,12 +6,14 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <thread>
 using namespace std;
 
 const int UNDEFINED_QUBIT = -1;
 
 #include "circuit.cpp"
 #include "sipf.cpp"
+#include "routing.cpp"
 #include "swapping.cpp"
 #include "compiler.cpp"
 
@@ -23,6 +25,16 @@ int main(int argc, char** argv)
 	// int latency2 = 1;
 	// int latencySwp = 1;
 	bool optimal = false;
+	bool incremental = false;
+	MatchingOrder order = PATH_ORDER;
+	bool failing_sets = true;
+	int num_threads = 1;
+	SwapEngine engine = APPROX_SWAPS;
+	bool stats = false;
+	Topology topology = AUTO_TOPOLOGY;
+	bool pipeline = false;
+	char *swapCacheFileName = NULL;
+	bool verify = false;
 
 	// Parse command-line arguments:
 	for(int iter = 1; iter < argc; iter++)
@@ -40,6 +52,99 @@ int main(int argc, char** argv)
 		{
 			optimal = true;
 		}
+		else if (!strcmp(argv[iter], "-incremental"))
+		{
+			incremental = true;
+		}
+		else if (!strcmp(argv[iter], "-order"))
+		{
+			char *order_name = argv[++iter];
+			if (!strcmp(order_name, "int"))
+			{
+				order = INT_ORDER;
+			}
+			else if (!strcmp(order_name, "candidate"))
+			{
+				order = CANDIDATE_ORDER;
+			}
+			else if (!strcmp(order_name, "path"))
+			{
+				order = PATH_ORDER;
+			}
+			else
+			{
+				assert(false);
+			}
+		}
+		else if (!strcmp(argv[iter], "-swap"))
+		{
+			char *engine_name = argv[++iter];
+			if (!strcmp(engine_name, "approx"))
+			{
+				engine = APPROX_SWAPS;
+			}
+			else if (!strcmp(engine_name, "exact"))
+			{
+				engine = EXACT_SWAPS;
+			}
+			else if (!strcmp(engine_name, "dfs"))
+			{
+				engine = DFS_SWAPS;
+			}
+			else
+			{
+				assert(false);
+			}
+		}
+		else if (!strcmp(argv[iter], "-j"))
+		{
+			num_threads = atoi(argv[++iter]);
+			assert(num_threads >= 1);
+		}
+		else if (!strcmp(argv[iter], "-topology"))
+		{
+			char *topology_name = argv[++iter];
+			if (!strcmp(topology_name, "auto"))
+			{
+				topology = AUTO_TOPOLOGY;
+			}
+			else if (!strcmp(topology_name, "general"))
+			{
+				topology = GENERAL_TOPOLOGY;
+			}
+			else if (!strcmp(topology_name, "line"))
+			{
+				topology = LINE_TOPOLOGY;
+			}
+			else if (!strcmp(topology_name, "grid"))
+			{
+				topology = GRID_TOPOLOGY;
+			}
+			else
+			{
+				assert(false);
+			}
+		}
+		else if (!strcmp(argv[iter], "-stats"))
+		{
+			stats = true;
+		}
+		else if (!strcmp(argv[iter], "-pipeline"))
+		{
+			pipeline = true;
+		}
+		else if (!strcmp(argv[iter], "-swap-cache"))
+		{
+			swapCacheFileName = argv[++iter];
+		}
+		else if (!strcmp(argv[iter], "-verify"))
+		{
+			verify = true;
+		}
+		else if (!strcmp(argv[iter], "-no-failing-sets"))
+		{
+			failing_sets = false;
+		}
 		else if (!qasmFileName)
 		{
 			qasmFileName = argv[iter];
@@ -56,11 +161,19 @@ int main(int argc, char** argv)
 
 	// Preprocess Circuit
 	int num_logical_qubits = -1;
-	pair<vector<vector<int>>, vector<GateNode*>> preprocessed = preprocess_circuit(
+	Circuit circuit = preprocess_circuit(
 		qasmFileName,
-		num_logical_qubits);
-	vector<vector<int>> live_ranges = preprocessed.first;
-	vector<GateNode*> gates_circuit = preprocessed.second;
+		num_logical_qubits,
+		num_threads);
+	vector<vector<int>> &live_ranges = circuit.live_ranges;
+	GateTable &gates_circuit = circuit.gates;
+
+	// Before the search, so runs killed by a timeout still report them
+	if (stats)
+	{
+		cerr << "Read Seconds: " << circuit.seconds << endl;
+		cerr << "Read MB per Second: " << circuit.num_bytes / max(circuit.seconds, 1e-9) / 1e6 << endl;
+	}
 
 	// Parse the coupling map; put edges into a set
 	int num_physical_qubits = -1;
@@ -71,33 +184,83 @@ int main(int argc, char** argv)
 		num_physical_qubits);
 	assert(num_physical_qubits >= num_logical_qubits);
 
-	// Produce Mappings
-	vector<pair<pair<int, int>, vector<int>>> mappings = sipf(
-		couplings,
-		num_logical_qubits,
-		num_physical_qubits,
-		live_ranges,
-		gates_circuit,
-		optimal);
-
-	// Calculate Swaps
-	vector<vector<pair<int, int>>> swaps = calculate_swaps(
-		mappings,
-		couplings,
-		num_logical_qubits,
-		num_physical_qubits);
+	// Produce Mappings and Calculate Swaps, on separate threads if pipelined
+	vector<pair<pair<int, int>, vector<int>>> mappings;
+	vector<vector<pair<int, int>>> swaps;
+	SwapStats swap_stats;
+	if (pipeline)
+	{
+		SpscQueue<pair<pair<int, int>, vector<int>>> queue(64);
+		thread partitioner([&]() {
+			sipf(
+				couplings,
+				num_logical_qubits,
+				num_physical_qubits,
+				live_ranges,
+				gates_circuit,
+				optimal,
+				incremental,
+				order,
+				failing_sets,
+				num_threads,
+				&queue);
+		});
+		swaps = calculate_swaps(
+			mappings,
+			couplings,
+			num_logical_qubits,
+			num_physical_qubits,
+			engine,
+			topology,
+			swap_stats,
+			swapCacheFileName,
+			&queue);
+		partitioner.join();
+	}
+	else
+	{
+		mappings = sipf(
+			couplings,
+			num_logical_qubits,
+			num_physical_qubits,
+			live_ranges,
+			gates_circuit,
+			optimal,
+			incremental,
+			order,
+			failing_sets,
+			num_threads,
+			NULL);
+		swaps = calculate_swaps(
+			mappings,
+			couplings,
+			num_logical_qubits,
+			num_physical_qubits,
+			engine,
+			topology,
+			swap_stats,
+			swapCacheFileName,
+			NULL);
+	}
+	if (stats)
+	{
+		cerr << "Swap Nodes: " << swap_stats.nodes << endl;
+		cerr << "Swap Layers: " << swap_stats.layers << endl;
+		cerr << "Swap Seconds: " << swap_stats.seconds << endl;
+		cerr << "Swap Nodes per Second: " << (long long)(swap_stats.nodes / max(swap_stats.seconds, 1e-9)) << endl;
+		cerr << "Swap Cache Hits: " << swap_stats.cache_hits << endl;
+	}
 
-	// Compile Circuit
-	string circuit = compile_circuit(
+	// Compile Circuit and Output Circuit
+	compile_circuit(
 		qasmFileName,
+		circuit,
 		mappings,
 		swaps,
-		gates_circuit,
 		couplings,
-		num_physical_qubits);
-
-	// Output Circuit
-	cout << circuit;
+		num_physical_qubits,
+		verify,
+		STDOUT_FILENO);
 
 	return 0;
 }
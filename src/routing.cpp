@@ -0,0 +1,402 @@
+#include <vector>
+#include <set>
+#include <queue>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+// Shape of the Coupling Graph for Swap Routing
+enum Topology
+{
+    AUTO_TOPOLOGY,      // detect lines and grids
+    GENERAL_TOPOLOGY,   // always search for swaps
+    LINE_TOPOLOGY,      // path of physical qubits
+    GRID_TOPOLOGY       // rows by columns of physical qubits
+};
+
+/**
+ * Breadth First Distances from a Physical Qubit
+ * @param coupling_graph Input: Adjacent Physical Qubits
+ * @param source Input: First Physical Qubit
+ * @returns distance of every physical qubit, -1 if unreachable
+ */
+static vector<int>
+create_distances(
+    vector<set<int>> &coupling_graph,
+    int source)
+{
+    vector<int> distances(coupling_graph.size(), -1);
+    queue<int> frontier;
+    distances[source] = 0;
+    frontier.push(source);
+    while (!frontier.empty())
+    {
+        int u = frontier.front();
+        frontier.pop();
+        for (int v : coupling_graph[u])
+        {
+            if (distances[v] == -1)
+            {
+                distances[v] = distances[u] + 1;
+                frontier.push(v);
+            }
+        }
+    }
+    return distances;
+}
+
+/**
+ * Find Rows and Columns of a Coupling Graph shaped as a grid
+ * Corner A is at (0, 0) and a corner B at (0, C - 1), so the distances
+ * from both give r + c and r + C - 1 - c for every physical qubit
+ * @param coupling_graph Input: Adjacent Physical Qubits
+ * @param min_rows Input: Fewest Rows to try, 1 for a line
+ * @param max_rows Input: Most Rows to try
+ * @returns physical qubits of every row, empty if the graph is no such grid
+ */
+static vector<vector<int>>
+create_grid_layout(
+    vector<set<int>> &coupling_graph,
+    int min_rows,
+    int max_rows)
+{
+    int num_physical_qubits = coupling_graph.size();
+    int num_edges = 0;
+    for (set<int> &neighbors : coupling_graph)
+    {
+        num_edges += neighbors.size();
+    }
+    num_edges /= 2;
+
+    for (int rows = min_rows; rows <= max_rows && rows * rows <= num_physical_qubits; rows++)
+    {
+        int columns = num_physical_qubits / rows;
+        if (columns < 2 ||
+            rows * columns != num_physical_qubits ||
+            rows * (columns - 1) + columns * (rows - 1) != num_edges)
+        {
+            continue;
+        }
+
+        // Corners
+        unsigned int corner_degree = rows == 1 ? 1 : 2;
+        vector<int> corners;
+        for (int q = 0; q < num_physical_qubits; q++)
+        {
+            if (coupling_graph[q].size() == corner_degree)
+            {
+                corners.push_back(q);
+            }
+        }
+        if (corners.size() != (rows == 1 ? 2u : 4u))
+        {
+            continue;
+        }
+        vector<int> distances_a = create_distances(coupling_graph, corners[0]);
+        int corner_b = UNDEFINED_QUBIT;
+        for (int corner : corners)
+        {
+            if (distances_a[corner] == columns - 1)
+            {
+                corner_b = corner;
+                break;
+            }
+        }
+        if (corner_b == UNDEFINED_QUBIT)
+        {
+            continue;
+        }
+        vector<int> distances_b = create_distances(coupling_graph, corner_b);
+
+        // Coordinates
+        vector<vector<int>> layout(rows, vector<int>(columns, UNDEFINED_QUBIT));
+        vector<int> row_of(num_physical_qubits);
+        vector<int> column_of(num_physical_qubits);
+        bool grid = true;
+        for (int q = 0; q < num_physical_qubits && grid; q++)
+        {
+            int sum = distances_a[q] + distances_b[q] - (columns - 1);
+            int difference = distances_a[q] - distances_b[q] + (columns - 1);
+            int r = sum / 2;
+            int c = difference / 2;
+            grid = distances_a[q] >= 0 && distances_b[q] >= 0 &&
+                sum % 2 == 0 && difference % 2 == 0 &&
+                r >= 0 && r < rows && c >= 0 && c < columns &&
+                layout[r][c] == UNDEFINED_QUBIT;
+            if (grid)
+            {
+                layout[r][c] = q;
+                row_of[q] = r;
+                column_of[q] = c;
+            }
+        }
+
+        // Every edge joins grid neighbors
+        for (int q = 0; q < num_physical_qubits && grid; q++)
+        {
+            for (int neighbor : coupling_graph[q])
+            {
+                if (abs(row_of[q] - row_of[neighbor]) + abs(column_of[q] - column_of[neighbor]) != 1)
+                {
+                    grid = false;
+                }
+            }
+        }
+
+        if (grid)
+        {
+            return layout;
+        }
+    }
+
+    return vector<vector<int>>();
+}
+
+/**
+ * Find the Line or Grid Layout of a Coupling Graph
+ * @param coupling_graph Input: Adjacent Physical Qubits
+ * @param topology Input: Shape to detect, or the shape hinted by the user
+ * @returns physical qubits of every row, empty for general coupling graphs
+ */
+static vector<vector<int>>
+create_layout(
+    vector<set<int>> &coupling_graph,
+    Topology topology)
+{
+    int num_physical_qubits = coupling_graph.size();
+    vector<vector<int>> layout;
+    if (topology == AUTO_TOPOLOGY || topology == LINE_TOPOLOGY)
+    {
+        layout = create_grid_layout(coupling_graph, 1, 1);
+    }
+    if (layout.empty() && (topology == AUTO_TOPOLOGY || topology == GRID_TOPOLOGY))
+    {
+        layout = create_grid_layout(coupling_graph, 2, num_physical_qubits);
+    }
+    if (layout.empty() && (topology == LINE_TOPOLOGY || topology == GRID_TOPOLOGY))
+    {
+        cerr << "Coupling Graph is not a " << (topology == LINE_TOPOLOGY ? "line" : "grid") << endl;
+        exit(1);
+    }
+    return layout;
+}
+
+/**
+ * Odd-Even Transposition Sort of the Tokens along a Line of Physical Qubits
+ * Swapping two empty qubits only relabels them, so no swap is emitted
+ * @param line Input: Physical Qubits in order
+ * @param occupant Input/Output: Token of each Physical Qubit
+ * @param keys Input: Sort Key of each Token
+ * @param num_logical_qubits Input: Tokens below are Logical Qubits
+ * @param swaps Output: Swaps between Physical Qubits
+ */
+static void
+sort_line(
+    vector<int> &line,
+    vector<int> &occupant,
+    vector<int> &keys,
+    int num_logical_qubits,
+    vector<pair<int, int>> &swaps)
+{
+    int length = line.size();
+    for (int round = 0; round < length; round++)
+    {
+        for (int j = round % 2; j + 1 < length; j += 2)
+        {
+            int u = line[j];
+            int v = line[j + 1];
+            if (keys[occupant[u]] > keys[occupant[v]])
+            {
+                if (occupant[u] < num_logical_qubits || occupant[v] < num_logical_qubits)
+                {
+                    swaps.push_back(pair<int, int>(u, v));
+                }
+                swap(occupant[u], occupant[v]);
+            }
+        }
+    }
+}
+
+/**
+ * Augment the Matching of Source Columns to Destination Columns (Kuhn)
+ * @param source Input: Source Column to match
+ * @param column_tokens Input: Tokens of each Source Column without a row
+ * @param source_column Input: Source Column of each Token
+ * @param target_column Input: Destination Column of each Token
+ * @param matched Input/Output: Token matched to each Destination Column
+ * @param visited Input/Output: Destination Columns on the current path
+ * @returns whether the source column is matched
+ */
+static bool
+match_column(
+    int source,
+    vector<vector<int>> &column_tokens,
+    vector<int> &source_column,
+    vector<int> &target_column,
+    vector<int> &matched,
+    vector<bool> &visited)
+{
+    for (int token : column_tokens[source])
+    {
+        int target = target_column[token];
+        if (visited[target])
+        {
+            continue;
+        }
+        visited[target] = true;
+        if (matched[target] == UNDEFINED_QUBIT ||
+            match_column(
+                source_column[matched[target]],
+                column_tokens,
+                source_column,
+                target_column,
+                matched,
+                visited))
+        {
+            matched[target] = token;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Route a Permutation on a Grid in three phases (Alon, Chung and Graham 1994)
+ * Columns first spread the tokens so every row holds one token per
+ * destination column, rows then move every token to its column, and
+ * columns finally move every token to its row; a line is a single row
+ * @param mapping1 Input: Initial Mapping
+ * @param mapping2 Input: Final Mapping
+ * @param layout Input: Physical Qubits of every Row
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @param swaps Output: Swaps between Physical Qubits
+ */
+static void
+route_layout(
+    vector<int> &mapping1,
+    vector<int> &mapping2,
+    vector<vector<int>> &layout,
+    int num_logical_qubits,
+    vector<pair<int, int>> &swaps)
+{
+    int rows = layout.size();
+    int columns = layout[0].size();
+    int num_physical_qubits = rows * columns;
+    vector<int> row_of(num_physical_qubits);
+    vector<int> column_of(num_physical_qubits);
+    vector<vector<int>> column_lines(columns, vector<int>(rows));
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            row_of[layout[r][c]] = r;
+            column_of[layout[r][c]] = c;
+            column_lines[c][r] = layout[r][c];
+        }
+    }
+
+    // Tokens: logical qubits, then empty qubits, which on a grid stay put
+    // when free at the end and otherwise take the free qubits in layout
+    // order, keeping their order along a line
+    vector<int> occupant(num_physical_qubits, UNDEFINED_QUBIT);
+    vector<int> destination(num_physical_qubits, UNDEFINED_QUBIT);
+    vector<bool> destined(num_physical_qubits, false);
+    for (int i = 0; i < num_logical_qubits; i++)
+    {
+        occupant[mapping1[i]] = i;
+        destination[i] = mapping2[i];
+        destined[mapping2[i]] = true;
+    }
+    int token = num_logical_qubits;
+    for (int q = 0; q < num_physical_qubits; q++)
+    {
+        if (rows > 1 && occupant[q] == UNDEFINED_QUBIT && !destined[q])
+        {
+            occupant[q] = token;
+            destination[token++] = q;
+            destined[q] = true;
+        }
+    }
+    vector<int> free_qubits;
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            if (!destined[layout[r][c]])
+            {
+                free_qubits.push_back(layout[r][c]);
+            }
+        }
+    }
+    for (int r = 0, k = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            if (occupant[layout[r][c]] == UNDEFINED_QUBIT)
+            {
+                occupant[layout[r][c]] = token;
+                destination[token++] = free_qubits[k++];
+            }
+        }
+    }
+
+    // Row of every Token from a Perfect Matching per Row, the multigraph
+    // of source to destination columns is regular so one always exists
+    vector<int> keys(num_physical_qubits);
+    vector<vector<int>> column_tokens(columns);
+    vector<int> source_column(num_physical_qubits);
+    vector<int> target_column(num_physical_qubits);
+    for (int q = 0; q < num_physical_qubits; q++)
+    {
+        column_tokens[column_of[q]].push_back(occupant[q]);
+        source_column[occupant[q]] = column_of[q];
+        target_column[occupant[q]] = column_of[destination[occupant[q]]];
+    }
+    vector<int> matched(columns);
+    vector<bool> visited(columns);
+    for (int r = 0; r < rows; r++)
+    {
+        fill(matched.begin(), matched.end(), UNDEFINED_QUBIT);
+        for (int c = 0; c < columns; c++)
+        {
+            fill(visited.begin(), visited.end(), false);
+            bool matching = match_column(c, column_tokens, source_column, target_column, matched, visited);
+            assert(matching);
+        }
+        for (int t : matched)
+        {
+            keys[t] = r;
+            vector<int> &tokens = column_tokens[source_column[t]];
+            tokens.erase(find(tokens.begin(), tokens.end(), t));
+        }
+    }
+
+    // Columns: every row holds one token per destination column
+    for (vector<int> &line : column_lines)
+    {
+        sort_line(line, occupant, keys, num_logical_qubits, swaps);
+    }
+
+    // Rows: every token reaches its destination column
+    for (int t = 0; t < num_physical_qubits; t++)
+    {
+        keys[t] = column_of[destination[t]];
+    }
+    for (vector<int> &line : layout)
+    {
+        sort_line(line, occupant, keys, num_logical_qubits, swaps);
+    }
+
+    // Columns: every token reaches its destination row
+    for (int t = 0; t < num_physical_qubits; t++)
+    {
+        keys[t] = row_of[destination[t]];
+    }
+    for (vector<int> &line : column_lines)
+    {
+        sort_line(line, occupant, keys, num_logical_qubits, swaps);
+    }
+}
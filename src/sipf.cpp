@@ -6,90 +6,493 @@
 #include <algorithm>
 #include <limits>
 #include <numeric>
-#include "GateNode.hpp"
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "GateTable.hpp"
+#include "DynamicBitset.hpp"
+#include "FixedBitset.hpp"
+#include "SpscQueue.hpp"
+#include "DistanceMatrix.hpp"
 using namespace std;
 
+/**
+ * Matching Order of the Extendable Logical Qubits in the Frontier
+ */
+enum MatchingOrder
+{
+    INT_ORDER,          // every extendable qubit in increasing order
+    CANDIDATE_ORDER,    // qubit with the fewest extendable candidates (DAF)
+    PATH_ORDER          // qubit with the fewest weighted candidate paths (DAF)
+};
+
+/**
+ * Choice of a frame of the backtracking search, ordered by logical qubit then index
+ */
+struct Choice
+{
+    int logical;                    // logical qubit matched by the frame
+    int index;                      // index in its candidate list
+    int physical;                   // candidate matched to it
+};
+
+/**
+ * Tasks of the parallel backtracking search shared by every thread
+ * A task is the choice path from the root of the first query graph to a frame;
+ * each thread takes its newest task first and steals the oldest of the others
+ */
+struct SearchPool
+{
+    vector<deque<vector<Choice>>> tasks;    // choice paths to search per thread
+    vector<mutex> locks;            // lock of the tasks per thread
+    atomic<int> pending;            // tasks given and not finished
+    atomic<int> hungry;             // threads waiting for a task
+    atomic<bool> found;             // whether a task succeeded
+    mutex best_lock;                // lock of the best choice path
+    vector<Choice> best;            // lowest successful choice path
+    int split_depth;                // frames of the first query graph
+
+    SearchPool(int num_threads, int split_depth)
+        : tasks(num_threads),
+          locks(num_threads),
+          pending(0),
+          hungry(0),
+          found(false),
+          split_depth(split_depth)
+    {
+    }
+
+    void give(int thread_index, const vector<Choice> &task)
+    {
+        pending++;
+        lock_guard<mutex> guard(locks[thread_index]);
+        tasks[thread_index].push_back(task);
+    }
+
+    bool has_tasks(int thread_index)
+    {
+        lock_guard<mutex> guard(locks[thread_index]);
+        return !tasks[thread_index].empty();
+    }
+
+    // Wait for a task until every task is finished
+    bool take(int thread_index, vector<Choice> &task)
+    {
+        bool waiting = false;
+        while (true)
+        {
+            for (unsigned int offset = 0; offset < tasks.size(); offset++)
+            {
+                int victim = (thread_index + offset) % tasks.size();
+                lock_guard<mutex> guard(locks[victim]);
+                if (tasks[victim].empty())
+                {
+                    continue;
+                }
+                if (offset == 0)
+                {
+                    task = tasks[victim].back();
+                    tasks[victim].pop_back();
+                }
+                else
+                {
+                    task = tasks[victim].front();
+                    tasks[victim].pop_front();
+                }
+                if (waiting)
+                {
+                    hungry--;
+                }
+                return true;
+            }
+            if (pending.load() == 0)
+            {
+                if (waiting)
+                {
+                    hungry--;
+                }
+                return false;
+            }
+            if (!waiting)
+            {
+                waiting = true;
+                hungry++;
+            }
+            this_thread::yield();
+        }
+    }
+
+    // Whether the first choices of a path come after the lowest successful path
+    bool after_best(const vector<Choice> &path, int length)
+    {
+        if (!found.load(memory_order_relaxed))
+        {
+            return false;
+        }
+        lock_guard<mutex> guard(best_lock);
+        return precedes(best, path, length);
+    }
+
+    // Whether the first choices of a path come before the other's
+    static bool precedes(const vector<Choice> &path, const vector<Choice> &other, int length)
+    {
+        length = min(length, (int)min(path.size(), other.size()));
+        for (int depth = 0; depth < length; depth++)
+        {
+            if (path[depth].logical != other[depth].logical)
+            {
+                return path[depth].logical < other[depth].logical;
+            }
+            if (path[depth].index != other[depth].index)
+            {
+                return path[depth].index < other[depth].index;
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * Partial Mapping shared by every frame of the backtracking search
+ * Logical qubits are matched and unmatched in place; children added to the
+ * frontier are pushed on the trail so a frame can retract exactly its own
+ */
+template <typename Bitset>
+struct SearchState
+{
+    vector<int> mapping;            // logical qubit -> physical qubit
+    vector<int> inverse;            // physical qubit -> logical qubit
+    Bitset seen;                    // matched logical qubits
+    Bitset mapped;                  // matched physical qubits
+    vector<bool> frontier;          // logical qubits to search next
+    vector<int> trail;              // logical qubits added to the frontier
+    vector<vector<int>> candidates; // candidate list per number of seen qubits
+    vector<int> scratch;            // candidate list while selecting a qubit
+    Bitset extendable;              // candidates while building a candidate list
+    vector<Bitset> failing_sets;    // failing set per number of seen qubits
+    int num_seen;
+    int num_frontier;
+    MatchingOrder order;
+    bool pruning;                   // skip siblings outside the failing set
+    int num_threads;                // threads of the parallel search
+    vector<Choice> path;            // choice per number of seen qubits
+    vector<unsigned int> limits;    // candidates left to a frame per number of seen qubits
+    vector<bool> donated;           // frames that gave candidates to other threads
+    SearchPool *pool;               // tasks of the parallel search, if any
+    int worker;                     // thread searching with this copy
+    int base_depth;                 // depth of the first frame of the current task
+    bool first_completed;           // first query graph embedded on its own
+
+    SearchState(int num_logical_qubits, int num_physical_qubits, MatchingOrder order, bool pruning, int num_threads)
+        : mapping(num_logical_qubits, UNDEFINED_QUBIT),
+          inverse(num_physical_qubits, UNDEFINED_QUBIT),
+          seen(num_logical_qubits),
+          mapped(num_physical_qubits),
+          frontier(num_logical_qubits, false),
+          candidates(num_logical_qubits + 1),
+          extendable(num_physical_qubits),
+          failing_sets(num_logical_qubits + 1, Bitset(num_logical_qubits)),
+          num_seen(0),
+          num_frontier(0),
+          order(order),
+          pruning(pruning),
+          num_threads(num_threads),
+          path(num_logical_qubits + 1),
+          limits(num_logical_qubits + 1, 0),
+          donated(num_logical_qubits + 1, false),
+          pool(NULL),
+          worker(0),
+          base_depth(0),
+          first_completed(false)
+    {
+        trail.reserve(num_logical_qubits);
+        scratch.reserve(num_physical_qubits);
+        for (vector<int> &candidates_list : candidates)
+        {
+            candidates_list.reserve(num_physical_qubits);
+        }
+    }
+
+    void reset()
+    {
+        fill(mapping.begin(), mapping.end(), UNDEFINED_QUBIT);
+        fill(inverse.begin(), inverse.end(), UNDEFINED_QUBIT);
+        seen.clear();
+        mapped.clear();
+        fill(frontier.begin(), frontier.end(), false);
+        trail.clear();
+        num_seen = 0;
+        num_frontier = 0;
+        first_completed = false;
+    }
+
+    // A copy searching after the lowest successful choice path stops early
+    bool cancelled()
+    {
+        return pool != NULL && pool->after_best(path, num_seen);
+    }
+};
+
 vector<pair<pair<int, int>, vector<int>>>
 sipf(
     set<pair<int, int>> &couplings,
     int num_logical_qubits,
     int num_physical_qubits,
     vector<vector<int>> live_ranges,
-    vector<GateNode*> gates_circuit,
-    bool optimal);
+    const GateTable &gates_circuit,
+    bool optimal,
+    bool incremental,
+    MatchingOrder order,
+    bool failing_sets,
+    int num_threads,
+    SpscQueue<pair<pair<int, int>, vector<int>>> *pipeline);
+
+template <typename Bitset>
+static vector<pair<pair<int, int>, vector<int>>>
+partition_circuit(
+    set<pair<int, int>> &couplings,
+    int num_logical_qubits,
+    int num_physical_qubits,
+    vector<vector<int>> live_ranges,
+    const GateTable &gates_circuit,
+    bool optimal,
+    bool incremental,
+    MatchingOrder order,
+    bool failing_sets,
+    int num_threads,
+    SpscQueue<pair<pair<int, int>, vector<int>>> *pipeline);
+
+template <typename Bitset>
+static bool
+embed_optimal(
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound,
+    set<pair<int, int>> &couplings,
+    int num_logical_qubits,
+    int num_physical_qubits,
+    SearchState<Bitset> &state,
+    vector<vector<pair<int, int>>> &nogoods);
+
+static vector<pair<int, int>>
+create_edge_set(
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound);
+
+static int
+find_nogood(
+    vector<vector<pair<int, int>>> &nogoods,
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound,
+    int num_logical_qubits);
+
+static void
+add_nogood(
+    vector<vector<pair<int, int>>> &nogoods,
+    vector<vector<set<int>>> &query_graphs,
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound,
+    bool first_completed);
+
+static void
+place_single_qubits(
+    vector<pair<pair<int, int>, vector<int>>> &mappings,
+    const GateTable &gates_circuit,
+    DistanceMatrix &distance_matrix,
+    int num_logical_qubits,
+    int num_physical_qubits);
+
+static vector<int>
+assign_min_cost(
+    vector<vector<int>> &costs,
+    int num_columns);
 
 static vector<vector<set<int>>>
 create_query_graphs(
-    vector<GateNode*> gates_circuit,
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound,
     int num_logical_qubits);
 
 static vector<set<int>>
 create_data_graph(
     set<pair<int, int>> &couplings,
     int num_physical_qubits,
-    set<int> filter_qubits);
+    const vector<bool> &filter_qubits);
+
+template <typename Bitset>
+static vector<Bitset>
+create_data_bitsets(
+    set<pair<int, int>> &couplings,
+    int num_physical_qubits,
+    const Bitset &filter_qubits);
 
-static pair<vector<set<int>>, pair<int, vector<set<int>>>>
+template <typename Bitset>
+static pair<vector<Bitset>, pair<int, vector<set<int>>>>
 create_dag(
     const vector<set<int>> &query_graph,
-    const vector<set<int>> &data_graph);
+    const vector<Bitset> &data_graph);
 
-static pair<vector<set<int>>, vector<set<int>>>
+template <typename Bitset>
+static pair<vector<Bitset>, vector<Bitset>>
 create_candidate_space(
     vector<set<int>> &query_graph,
-    vector<set<int>> &candidate_sets,
+    vector<Bitset> &candidate_sets,
+    vector<set<int>> &query_dag,
+    vector<Bitset> &data_graph);
+
+template <typename Bitset>
+static vector<vector<double>>
+create_path_weights(
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    vector<set<int>> &query_dag,
+    int root);
+
+static vector<int>
+create_topological_order(
+    vector<set<int>> &parents,
+    vector<set<int>> &query_dag,
+    int root);
+
+template <typename Bitset>
+static vector<Bitset>
+create_ancestors(
+    vector<set<int>> &parents,
+    vector<set<int>> &query_dag,
+    int root,
+    const Bitset &seen);
+
+template <typename Bitset>
+static void
+build_candidates(
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    SearchState<Bitset> &state,
+    int current,
+    vector<int> &candidates_list);
+
+template <typename Bitset>
+static int
+select_extendable(
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    vector<vector<double>> &weights,
+    SearchState<Bitset> &state);
+
+template <typename Bitset>
+static unsigned int
+extend_frontier(
+    SearchState<Bitset> &state,
+    vector<set<int>> &query_dag,
+    int current);
+
+template <typename Bitset>
+static bool
+merge_failing_set(
+    SearchState<Bitset> &state,
+    int current,
+    int depth);
+
+template <typename Bitset>
+static void
+add_conflicts(
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    vector<Bitset> &ancestors,
+    SearchState<Bitset> &state,
+    int current,
+    bool empty);
+
+template <typename Bitset>
+static void
+retract_frontier(
+    SearchState<Bitset> &state,
+    int current,
+    unsigned int trail_mark);
+
+template <typename Bitset>
+static void
+donate_tasks(
+    SearchState<Bitset> &state);
+
+template <typename Bitset>
+static bool
+search_parallel(
+    vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
+    set<pair<int, int>> &couplings,
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
     vector<set<int>> &query_dag,
-    vector<set<int>> &data_graph);
+    vector<vector<double>> &weights,
+    vector<Bitset> &ancestors,
+    SearchState<Bitset> &state,
+    int num_physical_qubits,
+    int current,
+    vector<int> &candidates_list,
+    pair<unsigned int, vector<set<int>>> *failure_heuristic);
 
+template <typename Bitset>
 static bool
 backtrack_level(
     vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
     set<pair<int, int>> &couplings,
-    vector<int> &mapping,
-    set<int> &seen,
-    set<int> &mapped,
+    SearchState<Bitset> &state,
     int num_physical_qubits,
     int previous,
     pair<unsigned int, vector<set<int>>> &failure_heuristic);
 
+template <typename Bitset>
 static bool
 backtrack_level_helper(
     vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
     set<pair<int, int>> &couplings,
-    vector<set<int>> &candidate_sets,
-    vector<set<int>> &candidate_edges,
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
     vector<set<int>> &parents,
     vector<set<int>> &query_dag,
-    vector<int> &mapping,
-    set<int> &frontier,
-    set<int> &seen,
-    set<int> &mapped,
+    vector<vector<double>> &weights,
+    vector<Bitset> &ancestors,
+    SearchState<Bitset> &state,
     int num_physical_qubits,
     int previous,
     pair<unsigned int, vector<set<int>>> &failure_heuristic);
 
+template <typename Bitset>
 static bool
 backtrack_level_optimal(
     vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
     set<pair<int, int>> &couplings,
-    vector<int> &mapping,
-    set<int> &seen,
-    set<int> &mapped,
+    SearchState<Bitset> &state,
     int num_physical_qubits,
     int previous);
 
+template <typename Bitset>
 static bool
 backtrack_level_helper_optimal(
     vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
     set<pair<int, int>> &couplings,
-    vector<set<int>> &candidate_sets,
-    vector<set<int>> &candidate_edges,
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
     vector<set<int>> &parents,
     vector<set<int>> &query_dag,
-    vector<int> &mapping,
-    set<int> &frontier,
-    set<int> &seen,
-    set<int> &mapped,
+    vector<vector<double>> &weights,
+    vector<Bitset> &ancestors,
+    SearchState<Bitset> &state,
     int num_physical_qubits,
     int previous);
 
@@ -99,83 +502,316 @@ sipf(
     int num_logical_qubits,
     int num_physical_qubits,
     vector<vector<int>> live_ranges,
-    vector<GateNode*> gates_circuit,
-    bool optimal)
+    const GateTable &gates_circuit,
+    bool optimal,
+    bool incremental,
+    MatchingOrder order,
+    bool failing_sets,
+    int num_threads,
+    SpscQueue<pair<pair<int, int>, vector<int>>> *pipeline)
+{
+    // Every Physical Qubit Set fits in a single Word
+    if (num_physical_qubits <= 64)
+    {
+        return partition_circuit<FixedBitset<1>>(
+            couplings,
+            num_logical_qubits,
+            num_physical_qubits,
+            live_ranges,
+            gates_circuit,
+            optimal,
+            incremental,
+            order,
+            failing_sets,
+            num_threads,
+            pipeline);
+    }
+    return partition_circuit<DynamicBitset>(
+        couplings,
+        num_logical_qubits,
+        num_physical_qubits,
+        live_ranges,
+        gates_circuit,
+        optimal,
+        incremental,
+        order,
+        failing_sets,
+        num_threads,
+        pipeline);
+}
+
+/**
+ * Partition the Circuit into Mappings with a Bitset Representation
+ * @param couplings Input: Coupling Graph Edges
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ * @param live_ranges Input: Gate Indices of each Logical Qubit
+ * @param gates_circuit Input: Gates of the Circuit
+ * @param optimal Input: Search the largest embeddable Partitions
+ * @param incremental Input: Grow the Partitions one Gate at a time
+ * @param order Input: Matching Order of the Search
+ * @param failing_sets Input: Prune the Search with Failing Sets
+ * @param num_threads Input: Threads searching the Root Candidates
+ * @param pipeline Output: Queue receiving each Mapping once found, if any
+ * @returns mappings with the gate range each one satisfies
+ */
+template <typename Bitset>
+static vector<pair<pair<int, int>, vector<int>>>
+partition_circuit(
+    set<pair<int, int>> &couplings,
+    int num_logical_qubits,
+    int num_physical_qubits,
+    vector<vector<int>> live_ranges,
+    const GateTable &gates_circuit,
+    bool optimal,
+    bool incremental,
+    MatchingOrder order,
+    bool failing_sets,
+    int num_threads,
+    SpscQueue<pair<pair<int, int>, vector<int>>> *pipeline)
 {
     int max_bound = gates_circuit.size();
     int lower_bound = 0;
     int upper_bound = max_bound;
     vector<pair<pair<int, int>, vector<int>>> mappings;
+    SearchState<Bitset> state(num_logical_qubits, num_physical_qubits, order, failing_sets, num_threads);
 
-    while (lower_bound < max_bound)
-    {
+    // Logical Edge Sets that failed to embed, kept across Partitions
+    vector<vector<pair<int, int>>> nogoods;
 
-        vector<GateNode*> sub_circuit = {
-            gates_circuit.begin() + lower_bound,
-            gates_circuit.begin() + upper_bound
-        };
+    // Adjacency Rows of the Physical Qubits
+    vector<Bitset> adjacency = create_data_bitsets(
+        couplings,
+        num_physical_qubits,
+        Bitset(num_physical_qubits));
 
-        // Input: query graphs
-        vector<vector<set<int>>> logical_islands = create_query_graphs(
-            sub_circuit,
-            num_logical_qubits);
+    // Distances to place the Single Qubit Islands near their previous qubits
+    vector<set<int>> coupling_graph = create_data_graph(
+        couplings,
+        num_physical_qubits,
+        vector<bool>(num_physical_qubits, false));
+    DistanceMatrix distance_matrix(coupling_graph);
 
-        // M <- EMPTY
-        vector<int> mapping(num_logical_qubits, UNDEFINED_QUBIT);
-        set<int> seen;
-        set<int> mapped;
+    while (lower_bound < max_bound)
+    {
+
+        // Incremental Search
+        if (incremental == true)
+        {
+            // Grow the partition from the lower bound one gate at a time
+            // A gate already satisfied by the current mapping is accepted
+            // with an adjacency lookup, and only otherwise is the prefix
+            // searched again for a new mapping
+            vector<int> mapping;
+            int upper = lower_bound;
+            while (upper < max_bound)
+            {
+                int control = gates_circuit.controls[upper];
+                int target = gates_circuit.targets[upper];
+                if (!mapping.empty() &&
+                    (control == UNDEFINED_QUBIT ||
+                     adjacency[mapping[control]][mapping[target]]))
+                {
+                    upper++;
+                }
+                // Remap
+                else if (embed_optimal(
+                    gates_circuit,
+                    lower_bound,
+                    upper + 1,
+                    couplings,
+                    num_logical_qubits,
+                    num_physical_qubits,
+                    state,
+                    nogoods))
+                {
+                    mapping = state.mapping;
+                    upper++;
+                }
+                else
+                {
+                    break;
+                }
+            }
 
+            // A single gate always embeds in a connected coupling graph
+            assert(upper > lower_bound);
+
+            mappings.push_back(pair<pair<int, int>, vector<int>>(
+                pair<int, int>(lower_bound, upper),
+                mapping));
+            place_single_qubits(
+                mappings,
+                gates_circuit,
+                distance_matrix,
+                num_logical_qubits,
+                num_physical_qubits);
+            if (pipeline != NULL)
+            {
+                pipeline->push(mappings.back());
+            }
+            lower_bound = upper;
+        }
         // Optimal Search
-        if (optimal == true)
+        else if (optimal == true)
         {
-            // Mapping is Found
-            if (backtrack_level_optimal(
-                logical_islands,
+            // Embeddability is monotone in the upper bound: if [lower, upper)
+            // embeds, every shorter prefix embeds too, so the maximal upper
+            // bound is found by galloping then binary searching between
+            // the largest embeddable and smallest unembeddable upper bounds
+            int embeddable = lower_bound;
+            int unembeddable = max_bound + 1;
+            vector<int> mapping;
+
+            // Whole remaining circuit
+            if (embed_optimal(
+                gates_circuit,
+                lower_bound,
+                max_bound,
                 couplings,
-                mapping,
-                seen,
-                mapped,
+                num_logical_qubits,
                 num_physical_qubits,
-                UNDEFINED_QUBIT))
+                state,
+                nogoods))
             {
-                mappings.push_back(pair<pair<int, int>, vector<int>>(
-                    pair<int, int>(lower_bound, upper_bound),
-                    mapping));
-                lower_bound = upper_bound;
-                upper_bound = max_bound;
+                embeddable = max_bound;
+                mapping = state.mapping;
             }
-            // Decrease Iteratively
             else
             {
-                upper_bound = upper_bound - 1;
+                unembeddable = max_bound;
+
+                // Gallop from the Lower Bound
+                for (int step = 1; lower_bound + step < unembeddable; step *= 2)
+                {
+                    if (embed_optimal(
+                        gates_circuit,
+                        lower_bound,
+                        lower_bound + step,
+                        couplings,
+                        num_logical_qubits,
+                        num_physical_qubits,
+                        state,
+                        nogoods))
+                    {
+                        embeddable = lower_bound + step;
+                        mapping = state.mapping;
+                    }
+                    else
+                    {
+                        unembeddable = lower_bound + step;
+                        break;
+                    }
+                }
+
+                // Binary Search between Bounds
+                while (unembeddable - embeddable > 1)
+                {
+                    int middle = embeddable + (unembeddable - embeddable) / 2;
+                    if (embed_optimal(
+                        gates_circuit,
+                        lower_bound,
+                        middle,
+                        couplings,
+                        num_logical_qubits,
+                        num_physical_qubits,
+                        state,
+                        nogoods))
+                    {
+                        embeddable = middle;
+                        mapping = state.mapping;
+                    }
+                    else
+                    {
+                        unembeddable = middle;
+                    }
+                }
+            }
+
+            // A single gate always embeds in a connected coupling graph
+            assert(embeddable > lower_bound);
+
+            mappings.push_back(pair<pair<int, int>, vector<int>>(
+                pair<int, int>(lower_bound, embeddable),
+                mapping));
+            place_single_qubits(
+                mappings,
+                gates_circuit,
+                distance_matrix,
+                num_logical_qubits,
+                num_physical_qubits);
+            if (pipeline != NULL)
+            {
+                pipeline->push(mappings.back());
             }
+            lower_bound = embeddable;
         }
         // Failure Heuristic Search
         else
         {
+            // A known Nogood bounds the Partition before the gate completing it
+            int nogood_bound = find_nogood(
+                nogoods,
+                gates_circuit,
+                lower_bound,
+                upper_bound,
+                num_logical_qubits);
+            if (nogood_bound < upper_bound)
+            {
+                upper_bound = nogood_bound;
+                continue;
+            }
+
+            // Input: query graphs
+            vector<vector<set<int>>> logical_islands = create_query_graphs(
+                gates_circuit,
+                lower_bound,
+                upper_bound,
+                num_logical_qubits);
+
+            // M <- EMPTY
+            state.reset();
+
             pair<unsigned int, vector<set<int>>> failure_heuristic(
                 1,
                 vector<set<int>>(num_logical_qubits));
             // Mapping is Found
             if (backtrack_level(
                 logical_islands,
+                0,
                 couplings,
-                mapping,
-                seen,
-                mapped,
+                state,
                 num_physical_qubits,
                 UNDEFINED_QUBIT,
                 failure_heuristic))
             {
                 mappings.push_back(pair<pair<int, int>, vector<int>>(
                     pair<int, int>(lower_bound, upper_bound),
-                    mapping));
+                    state.mapping));
+                place_single_qubits(
+                    mappings,
+                    gates_circuit,
+                    distance_matrix,
+                    num_logical_qubits,
+                    num_physical_qubits);
+                if (pipeline != NULL)
+                {
+                    pipeline->push(mappings.back());
+                }
                 lower_bound = upper_bound;
                 upper_bound = max_bound;
             }
             // Root Failure Heuristic
             else
             {
+                add_nogood(
+                    nogoods,
+                    logical_islands,
+                    gates_circuit,
+                    lower_bound,
+                    upper_bound,
+                    state.first_completed);
+
                 vector<int> conflict_gates;
                 for (int i = 0; i < (int)failure_heuristic.second.size(); i++)
                 {
@@ -203,62 +839,449 @@ sipf(
         }
     }
 
+    if (pipeline != NULL)
+    {
+        pipeline->close();
+    }
     return mappings;
 }
 
 /**
- * Create Logical Graph from Dependency Graph
- * @param frontier Input: First Set of Candidates
+ * Search for an Optimal Mapping of a Sub Circuit
+ * @param gates_circuit Input: Gates of the Circuit
+ * @param lower_bound Input: First Gate of the Sub Circuit
+ * @param upper_bound Input: Gate after the Last Gate of the Sub Circuit
+ * @param couplings Input: Coupling Graph Edges
  * @param num_logical_qubits Input: Number of Logical Qubits
- * @returns graph where indices are vertices and values are adjacent vertices
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ * @param state Output: Search State holding the Mapping if one is found
+ * @param nogoods Input/Output: Logical Edge Sets known not to embed
+ * @returns whether the Sub Circuit embeds in the Coupling Graph
  */
-static vector<vector<set<int>>>
-create_query_graphs(
-    vector<GateNode*> gates_circuit,
+template <typename Bitset>
+static bool
+embed_optimal(
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound,
+    set<pair<int, int>> &couplings,
+    int num_logical_qubits,
+    int num_physical_qubits,
+    SearchState<Bitset> &state,
+    vector<vector<pair<int, int>>> &nogoods)
+{
+    // Rejected without Search
+    if (find_nogood(nogoods, gates_circuit, lower_bound, upper_bound, num_logical_qubits) < upper_bound)
+    {
+        return false;
+    }
+
+    // Input: query graphs
+    vector<vector<set<int>>> logical_islands = create_query_graphs(
+        gates_circuit,
+        lower_bound,
+        upper_bound,
+        num_logical_qubits);
+
+    // M <- EMPTY
+    state.reset();
+
+    if (backtrack_level_optimal(
+        logical_islands,
+        0,
+        couplings,
+        state,
+        num_physical_qubits,
+        UNDEFINED_QUBIT))
+    {
+        return true;
+    }
+
+    add_nogood(
+        nogoods,
+        logical_islands,
+        gates_circuit,
+        lower_bound,
+        upper_bound,
+        state.first_completed);
+    return false;
+}
+
+/**
+ * Create the sorted Logical Edges of a Sub Circuit
+ * @param gates_circuit Input: Gates of the Circuit
+ * @param lower_bound Input: First Gate of the Sub Circuit
+ * @param upper_bound Input: Gate after the Last Gate of the Sub Circuit
+ * @returns edges (low qubit, high qubit) of every two qubit gate
+ */
+static vector<pair<int, int>>
+create_edge_set(
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound)
+{
+    vector<pair<int, int>> edges;
+    for (int g = lower_bound; g < upper_bound; g++)
+    {
+        int control = gates_circuit.controls[g];
+        int target = gates_circuit.targets[g];
+        if (control != UNDEFINED_QUBIT)
+        {
+            edges.push_back(pair<int, int>(
+                min(control, target),
+                max(control, target)));
+        }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    return edges;
+}
+
+/**
+ * Find the earliest Gate completing a Nogood in a Sub Circuit
+ * Physical qubits outnumber logical qubits, so only the edges of a query
+ * graph decide whether it embeds, and any superset of a Nogood fails too
+ * @param nogoods Input: Logical Edge Sets known not to embed
+ * @param gates_circuit Input: Gates of the Circuit
+ * @param lower_bound Input: First Gate of the Sub Circuit
+ * @param upper_bound Input: Gate after the Last Gate of the Sub Circuit
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @returns index of the Gate adding the last edge of a Nogood, or upper_bound if none
+ */
+static int
+find_nogood(
+    vector<vector<pair<int, int>>> &nogoods,
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound,
     int num_logical_qubits)
 {
-    vector<set<int>> logical_graph(num_logical_qubits);
+    if (nogoods.empty())
+    {
+        return upper_bound;
+    }
 
-    // Iterate Gates
+    // First Gate of each Logical Edge
+    vector<int> first_gates(num_logical_qubits * num_logical_qubits, upper_bound);
+    for (int g = lower_bound; g < upper_bound; g++)
     {
-        for (GateNode* current : gates_circuit)
+        int control = gates_circuit.controls[g];
+        int target = gates_circuit.targets[g];
+        if (control != UNDEFINED_QUBIT)
         {
-            // If Gate is target only
-            if (current->control == UNDEFINED_QUBIT)
+            int &first = first_gates[
+                min(control, target) * num_logical_qubits +
+                max(control, target)];
+            if (first == upper_bound)
             {
-                logical_graph[current->target].insert(current->target);
+                first = g;
             }
-            // If Gate is target and control
-            else
+        }
+    }
+
+    int earliest = upper_bound;
+    for (vector<pair<int, int>> &nogood : nogoods)
+    {
+        int completed = lower_bound;
+        for (pair<int, int> &edge : nogood)
+        {
+            completed = max(completed, first_gates[edge.first * num_logical_qubits + edge.second]);
+            if (completed >= earliest)
             {
-                logical_graph[current->target].insert(current->control);
-                logical_graph[current->control].insert(current->target);
+                break;
             }
         }
+        earliest = min(earliest, completed);
     }
+    return earliest;
+}
 
-    vector<vector<set<int>>> logical_islands;
-
-    // BFS Islands
+/**
+ * Record the Nogood of a failed Search
+ * If the first query graph never embedded on its own it fails alone,
+ * otherwise only the Sub Circuit as a whole is known to fail
+ * @param nogoods Output: Logical Edge Sets known not to embed
+ * @param query_graphs Input: Query Graphs of the Sub Circuit
+ * @param gates_circuit Input: Gates of the Circuit
+ * @param lower_bound Input: First Gate of the Sub Circuit
+ * @param upper_bound Input: Gate after the Last Gate of the Sub Circuit
+ * @param first_completed Input: First Query Graph embedded during the Search
+ */
+static void
+add_nogood(
+    vector<vector<pair<int, int>>> &nogoods,
+    vector<vector<set<int>>> &query_graphs,
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound,
+    bool first_completed)
+{
+    vector<pair<int, int>> nogood;
+    if (first_completed || query_graphs.empty())
     {
-        set<int> seen;
-        int last_searched = 0;
-
-        while ((int)seen.size() != num_logical_qubits)
+        nogood = create_edge_set(gates_circuit, lower_bound, upper_bound);
+    }
+    else
+    {
+        vector<set<int>> &logical_graph = query_graphs[0];
+        for (int u = 0; u < (int)logical_graph.size(); u++)
         {
-            vector<set<int>> logical_island(num_logical_qubits);
-
-            queue<int> search;
-            for (; last_searched < num_logical_qubits; last_searched++)
+            for (int v : logical_graph[u])
             {
-                if (seen.find(last_searched) == seen.end())
+                if (u < v)
                 {
-                    search.push(last_searched);
-                    break;
+                    nogood.push_back(pair<int, int>(u, v));
                 }
             }
+        }
+    }
 
-            while (!search.empty())
+    // Keep only the minimal Nogoods
+    nogoods.erase(
+        remove_if(nogoods.begin(), nogoods.end(), [&nogood](const vector<pair<int, int>> &other) {
+            return includes(other.begin(), other.end(), nogood.begin(), nogood.end());
+        }),
+        nogoods.end());
+    nogoods.push_back(nogood);
+}
+
+/**
+ * Place the Logical Qubits without two-qubit gates in the Partition, the
+ * single qubit islands, on the free Physical Qubits with the least total
+ * distance from the previous Mapping, instead of the lowest free ones
+ * @param mappings Input/Output: Mappings with the last Partition to place
+ * @param gates_circuit Input: Gates of the Circuit
+ * @param distance_matrix Input: Distances between Physical Qubits
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ */
+static void
+place_single_qubits(
+    vector<pair<pair<int, int>, vector<int>>> &mappings,
+    const GateTable &gates_circuit,
+    DistanceMatrix &distance_matrix,
+    int num_logical_qubits,
+    int num_physical_qubits)
+{
+    if (mappings.size() < 2)
+    {
+        return;
+    }
+    vector<int> &mapping = mappings.back().second;
+    vector<int> &previous_mapping = mappings[mappings.size() - 2].second;
+
+    // Logical Qubits of two-qubit gates keep their Physical Qubits
+    vector<bool> fixed(num_logical_qubits, false);
+    for (int index = mappings.back().first.first; index < mappings.back().first.second; index++)
+    {
+        if (gates_circuit.controls[index] != UNDEFINED_QUBIT)
+        {
+            fixed[gates_circuit.controls[index]] = true;
+            fixed[gates_circuit.targets[index]] = true;
+        }
+    }
+
+    vector<bool> occupied(num_physical_qubits, false);
+    vector<int> single_qubits;
+    for (int i = 0; i < num_logical_qubits; i++)
+    {
+        if (fixed[i] && mapping[i] != UNDEFINED_QUBIT)
+        {
+            occupied[mapping[i]] = true;
+        }
+        else if (!fixed[i])
+        {
+            single_qubits.push_back(i);
+        }
+    }
+    if (single_qubits.empty())
+    {
+        return;
+    }
+
+    vector<int> free_qubits;
+    for (int q = 0; q < num_physical_qubits; q++)
+    {
+        if (!occupied[q])
+        {
+            free_qubits.push_back(q);
+        }
+    }
+
+    // Distance of each Single Qubit to each Free Qubit
+    vector<vector<int>> costs(single_qubits.size(), vector<int>(free_qubits.size(), 0));
+    for (unsigned int row = 0; row < single_qubits.size(); row++)
+    {
+        int previous = previous_mapping[single_qubits[row]];
+        if (previous == UNDEFINED_QUBIT)
+        {
+            continue;
+        }
+        const uint16_t *distances = distance_matrix.row(previous);
+        for (unsigned int column = 0; column < free_qubits.size(); column++)
+        {
+            costs[row][column] = distances[free_qubits[column]];
+        }
+    }
+
+    vector<int> assignment = assign_min_cost(costs, free_qubits.size());
+    for (unsigned int row = 0; row < single_qubits.size(); row++)
+    {
+        mapping[single_qubits[row]] = free_qubits[assignment[row]];
+    }
+}
+
+/**
+ * Solve the rectangular Assignment Problem with the Hungarian Algorithm
+ * in O(n^2 m) with potentials (Kuhn 1955, Munkres 1957)
+ * @param costs Input: Cost of each Row for each Column, no more Rows than Columns
+ * @param num_columns Input: Number of Columns
+ * @returns column assigned to each row, with the least total cost
+ */
+static vector<int>
+assign_min_cost(
+    vector<vector<int>> &costs,
+    int num_columns)
+{
+    const long long INFINITE_COST = numeric_limits<long long>::max();
+    int num_rows = costs.size();
+    assert(num_rows <= num_columns);
+
+    // Potentials and the Row matched to each Column, 1-indexed with
+    // Column 0 as the Row being added
+    vector<long long> row_potential(num_rows + 1, 0);
+    vector<long long> column_potential(num_columns + 1, 0);
+    vector<int> matched(num_columns + 1, 0);
+    vector<int> way(num_columns + 1, 0);
+
+    for (int row = 1; row <= num_rows; row++)
+    {
+        matched[0] = row;
+        int column = 0;
+        vector<long long> slack(num_columns + 1, INFINITE_COST);
+        vector<bool> used(num_columns + 1, false);
+
+        // Grow the alternating tree until it reaches a free Column
+        do
+        {
+            used[column] = true;
+            int current_row = matched[column];
+            long long delta = INFINITE_COST;
+            int next_column = 0;
+            for (int j = 1; j <= num_columns; j++)
+            {
+                if (used[j])
+                {
+                    continue;
+                }
+                long long reduced = costs[current_row - 1][j - 1] -
+                    row_potential[current_row] - column_potential[j];
+                if (reduced < slack[j])
+                {
+                    slack[j] = reduced;
+                    way[j] = column;
+                }
+                if (slack[j] < delta)
+                {
+                    delta = slack[j];
+                    next_column = j;
+                }
+            }
+            for (int j = 0; j <= num_columns; j++)
+            {
+                if (used[j])
+                {
+                    row_potential[matched[j]] += delta;
+                    column_potential[j] -= delta;
+                }
+                else
+                {
+                    slack[j] -= delta;
+                }
+            }
+            column = next_column;
+        } while (matched[column] != 0);
+
+        // Flip the augmenting path
+        do
+        {
+            int previous_column = way[column];
+            matched[column] = matched[previous_column];
+            column = previous_column;
+        } while (column != 0);
+    }
+
+    vector<int> assignment(num_rows);
+    for (int j = 1; j <= num_columns; j++)
+    {
+        if (matched[j] != 0)
+        {
+            assignment[matched[j] - 1] = j - 1;
+        }
+    }
+    return assignment;
+}
+
+/**
+ * Create Logical Graph from Dependency Graph
+ * @param gates_circuit Input: Gates of the Circuit
+ * @param lower_bound Input: First Gate of the Sub Circuit
+ * @param upper_bound Input: Gate after the Last Gate of the Sub Circuit
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @returns graph where indices are vertices and values are adjacent vertices
+ */
+static vector<vector<set<int>>>
+create_query_graphs(
+    const GateTable &gates_circuit,
+    int lower_bound,
+    int upper_bound,
+    int num_logical_qubits)
+{
+    vector<set<int>> logical_graph(num_logical_qubits);
+
+    // Iterate Gates
+    {
+        for (int g = lower_bound; g < upper_bound; g++)
+        {
+            int control = gates_circuit.controls[g];
+            int target = gates_circuit.targets[g];
+
+            // If Gate is target only
+            if (control == UNDEFINED_QUBIT)
+            {
+                logical_graph[target].insert(target);
+            }
+            // If Gate is target and control
+            else
+            {
+                logical_graph[target].insert(control);
+                logical_graph[control].insert(target);
+            }
+        }
+    }
+
+    vector<vector<set<int>>> logical_islands;
+
+    // BFS Islands
+    {
+        set<int> seen;
+        int last_searched = 0;
+
+        while ((int)seen.size() != num_logical_qubits)
+        {
+            vector<set<int>> logical_island(num_logical_qubits);
+
+            queue<int> search;
+            for (; last_searched < num_logical_qubits; last_searched++)
+            {
+                if (seen.find(last_searched) == seen.end())
+                {
+                    search.push(last_searched);
+                    break;
+                }
+            }
+
+            while (!search.empty())
             {
                 int current = search.front();
                 search.pop();
@@ -304,21 +1327,21 @@ create_query_graphs(
  * Create Physical Graph from Coupling Architecture
  * @param couplings Input: Coupling Graph Edges
  * @param num_physical_qubits Input: Number of Physical Qubits
+ * @param filter_qubits Input: Physical Qubits to leave disconnected
  * @returns graph where indices are vertices and values are adjacent vertices
  */
 static vector<set<int>>
 create_data_graph(
     set<pair<int, int>> &couplings,
     int num_physical_qubits,
-    set<int> filter_qubits)
+    const vector<bool> &filter_qubits)
 {
     vector<set<int>> physical_graph(num_physical_qubits);
 
     // Iterate Edges to form Adjacency Lists
     for (pair<int, int> edge : couplings)
     {
-        if (filter_qubits.find(edge.first) == filter_qubits.end() &&
-            filter_qubits.find(edge.second) == filter_qubits.end())
+        if (!filter_qubits[edge.first] && !filter_qubits[edge.second])
         {
             physical_graph[edge.first].insert(edge.second);
             physical_graph[edge.second].insert(edge.first);
@@ -328,14 +1351,50 @@ create_data_graph(
     return physical_graph;
 }
 
-static pair<vector<set<int>>, pair<int, vector<set<int>>>>
+/**
+ * Create Physical Graph from Coupling Architecture as Adjacency Bitsets
+ * @param couplings Input: Coupling Graph Edges
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ * @param filter_qubits Input: Physical Qubits to leave disconnected
+ * @returns graph where indices are vertices and set bits are adjacent vertices
+ */
+template <typename Bitset>
+static vector<Bitset>
+create_data_bitsets(
+    set<pair<int, int>> &couplings,
+    int num_physical_qubits,
+    const Bitset &filter_qubits)
+{
+    vector<Bitset> physical_graph(num_physical_qubits, Bitset(num_physical_qubits));
+
+    // Iterate Edges to form Adjacency Bitsets
+    for (pair<int, int> edge : couplings)
+    {
+        if (!filter_qubits[edge.first] && !filter_qubits[edge.second])
+        {
+            physical_graph[edge.first].set(edge.second);
+            physical_graph[edge.second].set(edge.first);
+        }
+    }
+
+    return physical_graph;
+}
+
+template <typename Bitset>
+static pair<vector<Bitset>, pair<int, vector<set<int>>>>
 create_dag(
     const vector<set<int>> &query_graph,
-    const vector<set<int>> &data_graph)
+    const vector<Bitset> &data_graph)
 {
-    vector<set<int>> candidate_sets(query_graph.size());
+    vector<Bitset> candidate_sets(query_graph.size(), Bitset(data_graph.size()));
     pair<int, float> minimum_root(0, numeric_limits<double>::max());
 
+    vector<unsigned int> data_degrees(data_graph.size());
+    for (unsigned int v = 0; v < data_graph.size(); v++)
+    {
+        data_degrees[v] = data_graph[v].count();
+    }
+
     for (unsigned int root = 0; root < query_graph.size(); root++)
     {
         unsigned int root_degree = query_graph[root].size();
@@ -345,12 +1404,12 @@ create_dag(
         }
         for (unsigned int v = 0; v < data_graph.size(); v++)
         {
-            if (data_graph[v].size() >= root_degree)
+            if (data_degrees[v] >= root_degree)
             {
-                candidate_sets[root].insert(v);
+                candidate_sets[root].set(v);
             }
         }
-        double heuristic = (double)candidate_sets[root].size() / (double)root_degree;
+        double heuristic = (double)candidate_sets[root].count() / (double)root_degree;
         if (heuristic < minimum_root.second)
         {
             minimum_root.first = root;
@@ -372,87 +1431,710 @@ create_dag(
         {
             if (seen.find(neighbor) == seen.end())
             {
-                minimum_root_dag[current].insert(neighbor);
-                search.push(neighbor);
+                minimum_root_dag[current].insert(neighbor);
+                search.push(neighbor);
+            }
+        }
+    }
+
+    return pair<vector<Bitset>, pair<int, vector<set<int>>>>(
+        candidate_sets,
+        pair<int, vector<set<int>>>(minimum_root.first, minimum_root_dag));
+}
+
+template <typename Bitset>
+static pair<vector<Bitset>, vector<Bitset>>
+create_candidate_space(
+    vector<set<int>> &query_graph,
+    vector<Bitset> &candidate_sets,
+    vector<set<int>> &query_dag,
+    vector<Bitset> &data_graph)
+{
+    // Candidate Space = Sets(query -> set<data>), Edges(data -> set<data>)
+    vector<Bitset> candidate_edges(data_graph.size(), Bitset(data_graph.size()));
+    Bitset neighbors(data_graph.size());
+    for (unsigned int u1 = 0; u1 < candidate_sets.size(); u1++)
+    {
+        for (unsigned int u2 = 0; u2 < candidate_sets.size(); u2++)
+        {
+            // There is an edge between q1 and q2 in the query graph
+            if (query_graph[u1].find(u2) == query_graph[u1].end())
+            {
+                continue;
+            }
+            // Where d1 and d2 are data graph vertices in candidate sets of u1 and u2
+            // and there is an edge between d1 and d2 in the data graph,
+            // d2 -> d1 is added when visiting the edge from u2 to u1
+            for (int d1 = candidate_sets[u1].find_first(); d1 != -1; d1 = candidate_sets[u1].find_next(d1))
+            {
+                neighbors = candidate_sets[u2];
+                neighbors &= data_graph[d1];
+                candidate_edges[d1] |= neighbors;
+            }
+        }
+    }
+
+    return pair<vector<Bitset>, vector<Bitset>>(candidate_sets, candidate_edges);
+}
+
+/**
+ * Path Size Weights of the Candidate Space (DAF)
+ * The weight of a candidate is the number of candidate paths from it down
+ * the tree-like part of the DAG, following children with a single parent
+ * @param candidate_sets Input: Candidate Sets of the Logical Qubits
+ * @param candidate_edges Input: Candidate Edges between Physical Qubits
+ * @param parents Input: Parents of the Logical Qubits in the DAG
+ * @param query_dag Input: Logical DAG
+ * @param root Input: Root of the Logical DAG
+ * @returns weights indexed by logical qubit then physical qubit
+ */
+template <typename Bitset>
+static vector<vector<double>>
+create_path_weights(
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    vector<set<int>> &query_dag,
+    int root)
+{
+    vector<vector<double>> weights(
+        query_dag.size(),
+        vector<double>(candidate_edges.size(), 0));
+
+    vector<int> topological_order = create_topological_order(parents, query_dag, root);
+
+    // Weights from the Leaves up
+    for (auto it = topological_order.rbegin(); it != topological_order.rend(); it++)
+    {
+        int u = *it;
+        bool leaf = true;
+        for (int child : query_dag[u])
+        {
+            if (parents[child].size() != 1)
+            {
+                continue;
+            }
+            for (int v = candidate_sets[u].find_first(); v != -1; v = candidate_sets[u].find_next(v))
+            {
+                double paths = 0;
+                for (int neighbor = candidate_edges[v].find_first(); neighbor != -1; neighbor = candidate_edges[v].find_next(neighbor))
+                {
+                    paths += weights[child][neighbor];
+                }
+                weights[u][v] = leaf ? paths : min(weights[u][v], paths);
+            }
+            leaf = false;
+        }
+        if (leaf)
+        {
+            for (int v = candidate_sets[u].find_first(); v != -1; v = candidate_sets[u].find_next(v))
+            {
+                weights[u][v] = 1;
+            }
+        }
+    }
+
+    return weights;
+}
+
+/**
+ * Create the Topological Order of a Logical DAG
+ * @param parents Input: Parents of the Logical Qubits in the DAG
+ * @param query_dag Input: Logical DAG
+ * @param root Input: Root of the Logical DAG
+ * @returns logical qubits of the DAG, every parent before its children
+ */
+static vector<int>
+create_topological_order(
+    vector<set<int>> &parents,
+    vector<set<int>> &query_dag,
+    int root)
+{
+    vector<int> topological_order;
+    vector<int> in_degree(query_dag.size());
+    for (unsigned int u = 0; u < query_dag.size(); u++)
+    {
+        in_degree[u] = parents[u].size();
+    }
+    queue<int> search;
+    search.push(root);
+    while (!search.empty())
+    {
+        int current = search.front();
+        search.pop();
+        topological_order.push_back(current);
+        for (int child : query_dag[current])
+        {
+            if (--in_degree[child] == 0)
+            {
+                search.push(child);
+            }
+        }
+    }
+    return topological_order;
+}
+
+/**
+ * Create the Ancestors of every Logical Qubit in a Logical DAG (DAF Failing Sets)
+ * Qubits matched by previous islands are ancestors of every qubit, since
+ * they filtered the data graph the candidate space was built from
+ * @param parents Input: Parents of the Logical Qubits in the DAG
+ * @param query_dag Input: Logical DAG
+ * @param root Input: Root of the Logical DAG
+ * @param seen Input: Logical Qubits matched before the DAG
+ * @returns ancestors including itself indexed by logical qubit, empty if not in the DAG
+ */
+template <typename Bitset>
+static vector<Bitset>
+create_ancestors(
+    vector<set<int>> &parents,
+    vector<set<int>> &query_dag,
+    int root,
+    const Bitset &seen)
+{
+    vector<Bitset> ancestors(query_dag.size(), Bitset(seen.size()));
+    for (int u : create_topological_order(parents, query_dag, root))
+    {
+        ancestors[u] = seen;
+        ancestors[u].set(u);
+        for (int parent : parents[u])
+        {
+            ancestors[u] |= ancestors[parent];
+        }
+    }
+    return ancestors;
+}
+
+/**
+ * Build the Extendable Candidates of a Logical Qubit
+ * Candidates of current vertex =
+ *     Intersection of parents' mapped candidates' adjacency list
+ * @param candidate_sets Input: Candidate Sets of the Logical Qubits
+ * @param candidate_edges Input: Candidate Edges between Physical Qubits
+ * @param parents Input: Parents of the Logical Qubits in the DAG
+ * @param state Input: Shared Search State
+ * @param current Input: Logical Qubit with all parents matched
+ * @param candidates_list Output: Unmapped candidates adjacent to the parents
+ */
+template <typename Bitset>
+static void
+build_candidates(
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    SearchState<Bitset> &state,
+    int current,
+    vector<int> &candidates_list)
+{
+    Bitset &extendable = state.extendable;
+    extendable = candidate_sets[current];
+    extendable.subtract(state.mapped);
+    for (int parent : parents[current])
+    {
+        extendable &= candidate_edges[state.mapping[parent]];
+    }
+    candidates_list.clear();
+    extendable.append_to(candidates_list);
+}
+
+/**
+ * Select the Extendable Logical Qubit to match next (DAF Adaptive Matching Order)
+ * Its candidates are left in the candidate list of the current depth
+ * @param candidate_sets Input: Candidate Sets of the Logical Qubits
+ * @param candidate_edges Input: Candidate Edges between Physical Qubits
+ * @param parents Input: Parents of the Logical Qubits in the DAG
+ * @param weights Input: Path Size Weights, if ordered by path size
+ * @param state Input/Output: Shared Search State
+ * @returns selected logical qubit
+ */
+template <typename Bitset>
+static int
+select_extendable(
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    vector<vector<double>> &weights,
+    SearchState<Bitset> &state)
+{
+    int selected = UNDEFINED_QUBIT;
+    double selected_weight = numeric_limits<double>::max();
+    vector<int> &candidates_list = state.candidates[state.num_seen];
+
+    for (int current = 0; current < (int)state.frontier.size(); current++)
+    {
+        if (!state.frontier[current])
+        {
+            continue;
+        }
+        // Root is alone in the frontier when an island starts
+        if (parents[current].empty())
+        {
+            return current;
+        }
+        // Extendable if parents are matched
+        if (any_of(parents[current].begin(), parents[current].end(),
+                   [&state](int parent) { return !state.seen[parent]; }))
+        {
+            continue;
+        }
+
+        build_candidates(
+            candidate_sets,
+            candidate_edges,
+            parents,
+            state,
+            current,
+            state.scratch);
+
+        // Candidate Size or Path Size
+        double weight = 0;
+        if (state.order == CANDIDATE_ORDER)
+        {
+            weight = state.scratch.size();
+        }
+        else
+        {
+            for (int candidate : state.scratch)
+            {
+                weight += weights[current][candidate];
+            }
+        }
+
+        if (weight < selected_weight)
+        {
+            selected = current;
+            selected_weight = weight;
+            swap(candidates_list, state.scratch);
+        }
+    }
+
+    return selected;
+}
+
+/**
+ * Extend the frontier from a logical qubit being matched
+ * Newly extendable children are recorded on the trail to be retracted later
+ * @param state Input/Output: Shared Search State
+ * @param query_dag Input: Logical DAG
+ * @param current Input: Logical Qubit being matched
+ * @returns trail position to retract to
+ */
+template <typename Bitset>
+static unsigned int
+extend_frontier(
+    SearchState<Bitset> &state,
+    vector<set<int>> &query_dag,
+    int current)
+{
+    unsigned int trail_mark = state.trail.size();
+
+    state.frontier[current] = false;
+    state.num_frontier--;
+    for (int child : query_dag[current])
+    {
+        if (!state.seen[child] && !state.frontier[child])
+        {
+            state.frontier[child] = true;
+            state.num_frontier++;
+            state.trail.push_back(child);
+        }
+    }
+
+    state.seen.set(current);
+    state.num_seen++;
+
+    return trail_mark;
+}
+
+/**
+ * Retract the frontier to before a logical qubit was matched
+ * @param state Input/Output: Shared Search State
+ * @param current Input: Logical Qubit that was matched
+ * @param trail_mark Input: trail position returned by extend_frontier
+ */
+template <typename Bitset>
+static void
+retract_frontier(
+    SearchState<Bitset> &state,
+    int current,
+    unsigned int trail_mark)
+{
+    state.seen.reset(current);
+    state.num_seen--;
+
+    while (state.trail.size() > trail_mark)
+    {
+        state.frontier[state.trail.back()] = false;
+        state.num_frontier--;
+        state.trail.pop_back();
+    }
+
+    state.frontier[current] = true;
+    state.num_frontier++;
+}
+
+/**
+ * Merge the Failing Set of a failed child into the Failing Set of its frame
+ * If the logical qubit being matched is not in the child's failing set,
+ * no other candidate of it can resolve the failure (DAF Failing Sets)
+ * @param state Input/Output: Shared Search State
+ * @param current Input: Logical Qubit being matched
+ * @param depth Input: Number of seen qubits before current was matched
+ * @returns true if the remaining candidates of current are redundant
+ */
+template <typename Bitset>
+static bool
+merge_failing_set(
+    SearchState<Bitset> &state,
+    int current,
+    int depth)
+{
+    Bitset &failing_set = state.failing_sets[depth];
+    Bitset &child_failing_set = state.failing_sets[depth + 1];
+
+    if (!child_failing_set[current])
+    {
+        failing_set = child_failing_set;
+        return true;
+    }
+
+    failing_set |= child_failing_set;
+    return false;
+}
+
+/**
+ * Add the Conflicts of a Logical Qubit to the Failing Set of its frame
+ * Candidates adjacent to the parents but already mapped conflict with the
+ * logical qubit mapped to them; no candidates at all fails on the ancestors
+ * @param candidate_sets Input: Candidate Sets of the Logical Qubits
+ * @param candidate_edges Input: Candidate Edges between Physical Qubits
+ * @param parents Input: Parents of the Logical Qubits in the DAG
+ * @param ancestors Input: Ancestors of the Logical Qubits in the DAG
+ * @param state Input/Output: Shared Search State
+ * @param current Input: Logical Qubit that failed
+ * @param empty Input: whether current had no unmapped candidates
+ */
+template <typename Bitset>
+static void
+add_conflicts(
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    vector<Bitset> &ancestors,
+    SearchState<Bitset> &state,
+    int current,
+    bool empty)
+{
+    Bitset &failing_set = state.failing_sets[state.num_seen];
+
+    // Mapped candidates adjacent to the parents
+    Bitset &conflicts = state.extendable;
+    conflicts = candidate_sets[current];
+    conflicts &= state.mapped;
+    for (int parent : parents[current])
+    {
+        conflicts &= candidate_edges[state.mapping[parent]];
+    }
+
+    // Qubits of previous islands are already ancestors of current
+    for (int candidate = conflicts.find_first(); candidate != -1; candidate = conflicts.find_next(candidate))
+    {
+        failing_set |= ancestors[state.inverse[candidate]];
+    }
+
+    if (!conflicts.none() || empty)
+    {
+        failing_set |= ancestors[current];
+    }
+}
+
+/**
+ * Give the remaining candidates of the shallowest open frame to idle threads
+ * Only frames of the first query graph are split, later ones are searched
+ * by the thread that reached them
+ * @param state Input/Output: Search State of the giving thread
+ */
+template <typename Bitset>
+static void
+donate_tasks(
+    SearchState<Bitset> &state)
+{
+    // Idle threads steal the tasks this thread already has first
+    if (state.pool->has_tasks(state.worker))
+    {
+        return;
+    }
+
+    int depth_limit = min(state.num_seen, state.pool->split_depth);
+    for (int depth = state.base_depth; depth < depth_limit; depth++)
+    {
+        Choice &choice = state.path[depth];
+        if (choice.index + 1 >= (int)state.limits[depth])
+        {
+            continue;
+        }
+
+        // Pushed last to first so this thread takes the lowest back first
+        vector<Choice> task(state.path.begin(), state.path.begin() + depth + 1);
+        for (int index = state.limits[depth] - 1; index > choice.index; index--)
+        {
+            task.back().index = index;
+            task.back().physical = state.candidates[depth][index];
+            state.pool->give(state.worker, task);
+        }
+        state.limits[depth] = choice.index + 1;
+        state.donated[depth] = true;
+        return;
+    }
+}
+
+/**
+ * Search the Candidates of the Root of the first Query Graph on Threads
+ * Every root candidate starts as a task; busy threads split their open frames
+ * into more tasks when others are idle. A success cancels the tasks after
+ * its choice path, so the lowest successful path wins as in the sequential search
+ * @param query_graphs Input: Logical Islands to Embed
+ * @param level Input: Next Logical Island
+ * @param couplings Input: Coupling Graph Edges
+ * @param candidate_sets Input: Candidate Sets of the Logical Qubits
+ * @param candidate_edges Input: Candidate Edges between Physical Qubits
+ * @param parents Input: Parents of the Logical Qubits in the DAG
+ * @param query_dag Input: Logical DAG
+ * @param weights Input: Path Size Weights, if ordered by path size
+ * @param ancestors Input: Ancestors of the Logical Qubits in the DAG
+ * @param state Input/Output: Shared Search State, holding the Mapping if one is found
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ * @param current Input: Root of the Logical DAG, already extended
+ * @param candidates_list Input: Candidates of the Root
+ * @param failure_heuristic Input/Output: merged from every thread, NULL if optimal
+ * @returns true if a candidate of the root is embeddable
+ */
+template <typename Bitset>
+static bool
+search_parallel(
+    vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
+    set<pair<int, int>> &couplings,
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
+    vector<set<int>> &parents,
+    vector<set<int>> &query_dag,
+    vector<vector<double>> &weights,
+    vector<Bitset> &ancestors,
+    SearchState<Bitset> &state,
+    int num_physical_qubits,
+    int current,
+    vector<int> &candidates_list,
+    pair<unsigned int, vector<set<int>>> *failure_heuristic)
+{
+    int num_candidates = candidates_list.size();
+    int num_threads = state.num_threads;
+    if (num_candidates == 0)
+    {
+        return false;
+    }
+
+    // Logical Qubits of the first query graph
+    int split_depth = 1;
+    for (const set<int> &vertex_parents : parents)
+    {
+        if (!vertex_parents.empty())
+        {
+            split_depth++;
+        }
+    }
+
+    // Root Candidates dealt to the threads, lowest at the back
+    SearchPool pool(num_threads, split_depth);
+    for (int index = num_candidates - 1; index >= 0; index--)
+    {
+        Choice choice = {current, index, candidates_list[index]};
+        pool.give(index % num_threads, vector<Choice>(1, choice));
+    }
+
+    SearchState<Bitset> base = state;
+    base.pool = &pool;
+    vector<SearchState<Bitset>> states(num_threads, base);
+    SearchState<Bitset> winner = base;
+
+    vector<pair<unsigned int, vector<set<int>>>> failure_heuristics;
+    if (failure_heuristic != NULL)
+    {
+        failure_heuristics.assign(num_threads, *failure_heuristic);
+    }
+
+    auto search = [&](int thread_index) {
+        SearchState<Bitset> &local = states[thread_index];
+        local.worker = thread_index;
+        vector<Choice> task;
+        vector<unsigned int> trail_marks;
+        while (pool.take(thread_index, task))
+        {
+            if (pool.after_best(task, task.size()))
+            {
+                pool.pending--;
+                continue;
+            }
+
+            // Replay the Choice Path, the root is already extended
+            trail_marks.assign(task.size(), 0);
+            for (unsigned int depth = 0; depth < task.size(); depth++)
+            {
+                Choice &choice = task[depth];
+                if (depth > 0)
+                {
+                    trail_marks[depth] = extend_frontier(local, query_dag, choice.logical);
+                }
+                local.mapping[choice.logical] = choice.physical;
+                local.inverse[choice.physical] = choice.logical;
+                local.mapped.set(choice.physical);
+                local.path[depth] = choice;
+            }
+            local.base_depth = task.size();
+
+            bool embedded = failure_heuristic != NULL
+                ? backtrack_level_helper(
+                      query_graphs,
+                      level,
+                      couplings,
+                      candidate_sets,
+                      candidate_edges,
+                      parents,
+                      query_dag,
+                      weights,
+                      ancestors,
+                      local,
+                      num_physical_qubits,
+                      task.back().logical,
+                      failure_heuristics[thread_index])
+                : backtrack_level_helper_optimal(
+                      query_graphs,
+                      level,
+                      couplings,
+                      candidate_sets,
+                      candidate_edges,
+                      parents,
+                      query_dag,
+                      weights,
+                      ancestors,
+                      local,
+                      num_physical_qubits,
+                      task.back().logical);
+
+            if (embedded)
+            {
+                // Keep the lowest successful choice path
+                vector<Choice> path(local.path.begin(), local.path.begin() + split_depth);
+                lock_guard<mutex> guard(pool.best_lock);
+                if (!pool.found || SearchPool::precedes(path, pool.best, split_depth))
+                {
+                    pool.best = path;
+                    pool.found = true;
+                    winner = local;
+                }
+                local = base;
+                local.worker = thread_index;
+            }
+            else
+            {
+                // Undo the Choice Path
+                for (int depth = task.size() - 1; depth >= 0; depth--)
+                {
+                    Choice &choice = task[depth];
+                    local.mapping[choice.logical] = UNDEFINED_QUBIT;
+                    local.inverse[choice.physical] = UNDEFINED_QUBIT;
+                    local.mapped.reset(choice.physical);
+                    if (depth > 0)
+                    {
+                        retract_frontier(local, choice.logical, trail_marks[depth]);
+                    }
+                }
             }
+            pool.pending--;
         }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < num_threads; t++)
+    {
+        threads.push_back(thread(search, t));
+    }
+    search(0);
+    for (thread &worker : threads)
+    {
+        worker.join();
     }
 
-    return pair<vector<set<int>>, pair<int, vector<set<int>>>>(
-        candidate_sets,
-        pair<int, vector<set<int>>>(minimum_root.first, minimum_root_dag));
-}
+    for (SearchState<Bitset> &local : states)
+    {
+        state.first_completed = state.first_completed || local.first_completed;
+    }
 
-static pair<vector<set<int>>, vector<set<int>>>
-create_candidate_space(
-    vector<set<int>> &query_graph,
-    vector<set<int>> &candidate_sets,
-    vector<set<int>> &query_dag,
-    vector<set<int>> &data_graph)
-{
-    // Candidate Space = Sets(query -> set<data>), Edges(data -> set<data>)
-    vector<set<int>> candidate_edges(data_graph.size());
-    for (unsigned int u1 = 0; u1 < candidate_sets.size(); u1++)
+    if (pool.found)
     {
-        for (unsigned int u2 = 0; u2 < candidate_sets.size(); u2++)
+        state = winner;
+        state.pool = NULL;
+        return true;
+    }
+
+    // Failure Heuristic of the deepest failures over every thread
+    if (failure_heuristic != NULL)
+    {
+        for (pair<unsigned int, vector<set<int>>> &local_heuristic : failure_heuristics)
         {
-            // There is an edge between q1 and q2 in the query graph
-            if (query_graph[u1].find(u2) == query_graph[u1].end())
+            if (local_heuristic.first > failure_heuristic->first)
             {
-                continue;
+                *failure_heuristic = local_heuristic;
             }
-            // Where d1 and d2 are data graph vertices in candidate sets of u1 and u2
-            for (int d1 : candidate_sets[u1])
+            else if (local_heuristic.first == failure_heuristic->first)
             {
-                for (int d2 : candidate_sets[u2])
+                for (unsigned int i = 0; i < local_heuristic.second.size(); i++)
                 {
-                    // There is an edge between d1 and d2 in the query graph
-                    if (data_graph[d1].find(d2) != data_graph[d1].end())
-                    {
-                        candidate_edges[d1].insert(d2);
-                        candidate_edges[d2].insert(d1);
-                    }
+                    failure_heuristic->second[i].insert(
+                        local_heuristic.second[i].begin(),
+                        local_heuristic.second[i].end());
                 }
             }
         }
     }
-
-    return pair<vector<set<int>>, vector<set<int>>>(candidate_sets, candidate_edges);
+    return false;
 }
 
+template <typename Bitset>
 static bool
 backtrack_level(
     vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
     set<pair<int, int>> &couplings,
-    vector<int> &mapping,
-    set<int> &seen,
-    set<int> &mapped,
+    SearchState<Bitset> &state,
     int num_physical_qubits,
     int previous,
     pair<unsigned int, vector<set<int>>> &failure_heuristic)
 {
 
-    if (query_graphs.empty())
+    // The first query graph embedded on its own
+    if (level == 1)
+    {
+        state.first_completed = true;
+    }
+
+    if (level == query_graphs.size())
     {
         return true;
     }
 
 
     // Input: query graph q
-    vector<set<int>> logical_graph = *query_graphs.begin();
+    vector<set<int>> &logical_graph = query_graphs[level];
 
     // Calculate size of logical island
     int logical_size = 0;
-    for_each(logical_graph.begin(), logical_graph.end(), [&logical_size](set<int> s) {
+    for_each(logical_graph.begin(), logical_graph.end(), [&logical_size](const set<int> &s) {
         logical_size += s.size();
     });
 
     // Input: data graph G
-    vector<set<int>> physical_graph = create_data_graph(couplings, num_physical_qubits, mapped);
-
-    // Backtrack(q, q_D, CS, M)
-    vector<vector<set<int>>> next_level = query_graphs;
-    next_level.erase(next_level.begin());
+    vector<Bitset> physical_graph = create_data_bitsets(couplings, num_physical_qubits, state.mapped);
 
     if (logical_size == 1)
     {
@@ -477,7 +2159,7 @@ backtrack_level(
         int physical_qubit = UNDEFINED_QUBIT;
         for (int q = 0; q < num_physical_qubits; q++)
         {
-            if (mapped.find(q) == mapped.end())
+            if (!state.mapped[q])
             {
                 physical_qubit = q;
                 break;
@@ -487,54 +2169,65 @@ backtrack_level(
         if (physical_qubit == UNDEFINED_QUBIT)
         {
             // Failure Heuristic for Single Qubit
-            if (seen.size() > failure_heuristic.first)
+            if ((unsigned int)state.num_seen > failure_heuristic.first)
             {
-                failure_heuristic.first = seen.size();
+                failure_heuristic.first = state.num_seen;
                 for (unsigned int i = 0; i < failure_heuristic.second.size(); i++)
                 {
                     failure_heuristic.second[i].clear();
                 }
                 failure_heuristic.second[logical_qubit].insert(logical_qubit);
             }
-            else if (seen.size() == failure_heuristic.first)
+            else if ((unsigned int)state.num_seen == failure_heuristic.first)
             {
                 failure_heuristic.second[logical_qubit].insert(logical_qubit);
             }
             return false;
         }
 
-        seen.insert(logical_qubit);
-        mapped.insert(physical_qubit);
-        mapping[logical_qubit] = physical_qubit;
+        state.seen.set(logical_qubit);
+        state.num_seen++;
+        state.mapped.set(physical_qubit);
+        state.mapping[logical_qubit] = physical_qubit;
+        state.inverse[physical_qubit] = logical_qubit;
 
-        return backtrack_level(
-            next_level,
+        if (backtrack_level(
+            query_graphs,
+            level + 1,
             couplings,
-            mapping,
-            seen,
-            mapped,
+            state,
             num_physical_qubits,
             logical_qubit,
-            failure_heuristic);
+            failure_heuristic))
+        {
+            return true;
+        }
+
+        state.mapping[logical_qubit] = UNDEFINED_QUBIT;
+        state.inverse[physical_qubit] = UNDEFINED_QUBIT;
+        state.mapped.reset(physical_qubit);
+        state.num_seen--;
+        state.seen.reset(logical_qubit);
+        return false;
     }
     else
     {
 
         // q_D <- BuildDAG(q, G)
-        pair<vector<set<int>>, pair<int, vector<set<int>>>> logical_dag_result = create_dag(
+        pair<vector<Bitset>, pair<int, vector<set<int>>>> logical_dag_result = create_dag(
             logical_graph,
             physical_graph);
-        vector<set<int>> candidate_sets = logical_dag_result.first;
+        vector<Bitset> candidate_sets = logical_dag_result.first;
         int dag_root = logical_dag_result.second.first;
         vector<set<int>> logical_dag = logical_dag_result.second.second;
 
         // CS <- BuildCS(q, q_D, G)
-        pair<vector<set<int>>, vector<set<int>>> candidate_space = create_candidate_space(
+        pair<vector<Bitset>, vector<Bitset>> candidate_space = create_candidate_space(
             logical_graph,
             candidate_sets,
             logical_dag,
             physical_graph);
-        vector<set<int>> candidate_edges = candidate_space.second;
+        vector<Bitset> candidate_edges = candidate_space.second;
 
         // Parents
         vector<set<int>> parents(logical_dag.size());
@@ -546,171 +2239,183 @@ backtrack_level(
             }
         }
 
-        set<int> frontier{dag_root};
-        return backtrack_level_helper(
-            next_level,
+        // Path Size Weights for the Adaptive Matching Order
+        vector<vector<double>> weights;
+        if (state.order == PATH_ORDER)
+        {
+            weights = create_path_weights(
+                candidate_sets,
+                candidate_edges,
+                parents,
+                logical_dag,
+                dag_root);
+        }
+
+        // Ancestors for the Failing Sets
+        vector<Bitset> ancestors;
+        if (state.pruning)
+        {
+            ancestors = create_ancestors(
+                parents,
+                logical_dag,
+                dag_root,
+                state.seen);
+        }
+
+        // Backtrack(q, q_D, CS, M)
+        state.frontier[dag_root] = true;
+        state.num_frontier++;
+        if (backtrack_level_helper(
+            query_graphs,
+            level + 1,
             couplings,
             candidate_sets,
             candidate_edges,
             parents,
             logical_dag,
-            mapping,
-            frontier,
-            seen,
-            mapped,
+            weights,
+            ancestors,
+            state,
             num_physical_qubits,
             previous,
-            failure_heuristic);
+            failure_heuristic))
+        {
+            return true;
+        }
+        state.num_frontier--;
+        state.frontier[dag_root] = false;
+        return false;
     }
 }
 
+template <typename Bitset>
 static bool
 backtrack_level_helper(
     vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
     set<pair<int, int>> &couplings,
-    vector<set<int>> &candidate_sets,
-    vector<set<int>> &candidate_edges,
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
     vector<set<int>> &parents,
     vector<set<int>> &query_dag,
-    vector<int> &mapping,
-    set<int> &frontier,
-    set<int> &seen,
-    set<int> &mapped,
+    vector<vector<double>> &weights,
+    vector<Bitset> &ancestors,
+    SearchState<Bitset> &state,
     int num_physical_qubits,
     int previous,
     pair<unsigned int, vector<set<int>>> &failure_heuristic)
 {
 
+    int depth = state.num_seen;
+    Bitset &failing_set = state.failing_sets[depth];
+
+    // Another thread found a mapping from an earlier choice path
+    if (state.cancelled())
+    {
+        return false;
+    }
+
+    // Idle threads take the remaining candidates of the shallowest open frame
+    // Failing sets would prune the split frames differently, changing the failure heuristic
+    if (state.pool != NULL && !state.pruning &&
+        state.pool->hungry.load(memory_order_relaxed) > 0)
+    {
+        donate_tasks(state);
+    }
+
     // If frontier is empty
-    if (frontier.empty())
+    if (state.num_frontier == 0)
     {
         // If no more query graphs, success
-        if (query_graphs.empty())
+        if (level == query_graphs.size())
         {
             return true;
         }
         // Otherwise, recursively call with new query graph
         else
         {
-            return backtrack_level(
+            if (backtrack_level(
                 query_graphs,
+                level,
                 couplings,
-                mapping,
-                seen,
-                mapped,
+                state,
                 num_physical_qubits,
                 previous,
-                failure_heuristic);
+                failure_heuristic))
+            {
+                return true;
+            }
+            // Failing Set of the next query graph is every matched qubit
+            if (state.pruning)
+            {
+                failing_set = state.seen;
+            }
+            return false;
         }
     }
 
-    // Currently ordered by int compare
-    for (int current : frontier)
+    // Adaptive Matching Order extends only the selected qubit,
+    // otherwise every extendable qubit is tried ordered by int compare
+    int selected = UNDEFINED_QUBIT;
+    if (state.order != INT_ORDER)
     {
+        selected = select_extendable(
+            candidate_sets,
+            candidate_edges,
+            parents,
+            weights,
+            state);
+    }
 
-        // If no parents, aka root
-        if (parents[current].empty())
-        {
-            set<int> new_frontier = frontier;
-            new_frontier.erase(current);
-            for (int child : query_dag[current])
-            {
-                new_frontier.insert(child);
-            }
-
-            set<int> new_seen = seen;
-            new_seen.insert(current);
-
-            vector<int> new_mapping = mapping;
-
-            set<int> new_mapped = mapped;
-
-            for (int candidate : candidate_sets[current])
-            {
-                new_mapping[current] = candidate;
-                new_mapped.insert(candidate);
+    // Failing Set of this frame, every matched qubit unless narrowed below
+    if (state.pruning)
+    {
+        failing_set = state.seen;
+    }
 
-                if (backtrack_level_helper(
-                        query_graphs,
-                        couplings,
-                        candidate_sets,
-                        candidate_edges,
-                        parents,
-                        query_dag,
-                        new_mapping,
-                        new_frontier,
-                        new_seen,
-                        new_mapped,
-                        num_physical_qubits,
-                        current,
-                        failure_heuristic))
-                {
-                    seen = new_seen;
-                    mapped = new_mapped;
-                    mapping = new_mapping;
-                    return true;
-                }
+    for (int current = 0; current < (int)state.frontier.size(); current++)
+    {
+        if (!state.frontier[current] ||
+            (selected != UNDEFINED_QUBIT && current != selected))
+        {
+            continue;
+        }
 
-                new_mapping[current] = UNDEFINED_QUBIT;
-                new_mapped.erase(candidate);
-            }
+        vector<int> &candidates_list = state.candidates[depth];
 
-            // Failure Heuristic
-            if (seen.size() > failure_heuristic.first)
-            {
-                failure_heuristic.first = seen.size();
-                for (unsigned int i = 0; i < failure_heuristic.second.size(); i++)
-                {
-                    failure_heuristic.second[i].clear();
-                }
-                if (previous != UNDEFINED_QUBIT)
-                {
-                    failure_heuristic.second[current].insert(previous);
-                }
-            }
-            else if (seen.size() == failure_heuristic.first)
-            {
-                failure_heuristic.first = seen.size();
-                if (previous != UNDEFINED_QUBIT)
-                {
-                    failure_heuristic.second[current].insert(previous);
-                }
-            }
+        // If no parents, aka root
+        if (parents[current].empty())
+        {
+            candidates_list.clear();
+            candidate_sets[current].append_to(candidates_list);
         }
         // If parents
         else
         {
-            // Extendable if parents are matched
-            if (any_of(parents[current].begin(), parents[current].end(),
-                       [&seen](int parent) { return seen.find(parent) == seen.end(); }))
-            {
-                continue;
-            }
-            // Candidates of current vertex =
-            //     Intersection of parents' mapped candidates' adjacency list
-            set<int> candidates_list;
-            for (int candidate : candidate_sets[current])
+            // Candidates of the selected qubit are built while selecting
+            if (selected == UNDEFINED_QUBIT)
             {
-                if (mapped.find(candidate) != mapped.end())
+                // Extendable if parents are matched
+                if (any_of(parents[current].begin(), parents[current].end(),
+                           [&state](int parent) { return !state.seen[parent]; }))
                 {
                     continue;
                 }
-                if (all_of(parents[current].begin(), parents[current].end(),
-                           [&candidate_edges, &mapping, candidate](int parent) {
-                               return (candidate_edges[mapping[parent]].find(candidate) !=
-                                       candidate_edges[mapping[parent]].end());
-                           }))
-                {
-                    candidates_list.insert(candidate);
-                }
+                build_candidates(
+                    candidate_sets,
+                    candidate_edges,
+                    parents,
+                    state,
+                    current,
+                    candidates_list);
             }
 
             if (candidates_list.empty())
             {
                 // Failure Heuristic
-                if (seen.size() > failure_heuristic.first)
+                if ((unsigned int)state.num_seen > failure_heuristic.first)
                 {
-                    failure_heuristic.first = seen.size();
+                    failure_heuristic.first = state.num_seen;
                     for (unsigned int i = 0; i < failure_heuristic.second.size(); i++)
                     {
                         failure_heuristic.second[i].clear();
@@ -720,92 +2425,141 @@ backtrack_level_helper(
                         failure_heuristic.second[current].insert(previous);
                     }
                 }
-                else if (seen.size() == failure_heuristic.first)
+                else if ((unsigned int)state.num_seen == failure_heuristic.first)
                 {
-                    failure_heuristic.first = seen.size();
+                    failure_heuristic.first = state.num_seen;
                     if (previous != UNDEFINED_QUBIT)
                     {
                         failure_heuristic.second[current].insert(previous);
                     }
                 }
             }
+        }
 
-            set<int> new_frontier = frontier;
-            new_frontier.erase(current);
-            for (int child : query_dag[current])
-            {
-                if (seen.find(child) == seen.end())
-                {
-                    new_frontier.insert(child);
-                }
-            }
-
-            set<int> new_seen = seen;
-            new_seen.insert(current);
-
-            vector<int> new_mapping = mapping;
+        unsigned int trail_mark = extend_frontier(state, query_dag, current);
 
-            set<int> new_mapped = mapped;
+        bool pruned = false;
+        if (state.pruning)
+        {
+            failing_set.clear();
+        }
+        state.limits[depth] = candidates_list.size();
+        state.donated[depth] = false;
 
-            for (int candidate : candidates_list)
+        // Root candidates of the first query graph start the parallel search
+        if (depth == 0 && state.num_threads > 1)
+        {
+            if (search_parallel(
+                    query_graphs,
+                    level,
+                    couplings,
+                    candidate_sets,
+                    candidate_edges,
+                    parents,
+                    query_dag,
+                    weights,
+                    ancestors,
+                    state,
+                    num_physical_qubits,
+                    current,
+                    candidates_list,
+                    &failure_heuristic))
+            {
+                return true;
+            }
+        }
+        else
+        {
+            for (unsigned int index = 0; index < state.limits[depth]; index++)
             {
-                new_mapping[current] = candidate;
-                new_mapped.insert(candidate);
+                int candidate = candidates_list[index];
+                state.path[depth] = {current, (int)index, candidate};
+                state.mapping[current] = candidate;
+                state.inverse[candidate] = current;
+                state.mapped.set(candidate);
 
                 if (backtrack_level_helper(
                         query_graphs,
+                        level,
                         couplings,
                         candidate_sets,
                         candidate_edges,
                         parents,
                         query_dag,
-                        new_mapping,
-                        new_frontier,
-                        new_seen,
-                        new_mapped,
+                        weights,
+                        ancestors,
+                        state,
                         num_physical_qubits,
                         current,
                         failure_heuristic))
                 {
-                    seen = new_seen;
-                    mapped = new_mapped;
-                    mapping = new_mapping;
                     return true;
                 }
 
-                new_mapping[current] = UNDEFINED_QUBIT;
-                new_mapped.erase(candidate);
-            }
+                state.mapping[current] = UNDEFINED_QUBIT;
+                state.inverse[candidate] = UNDEFINED_QUBIT;
+                state.mapped.reset(candidate);
 
-            // Failure Heuristic
-            if (seen.size() > failure_heuristic.first)
-            {
-                failure_heuristic.first = seen.size();
-                for (unsigned int i = 0; i < failure_heuristic.second.size(); i++)
-                {
-                    failure_heuristic.second[i].clear();
-                }
-                if (previous != UNDEFINED_QUBIT)
+                // Siblings are redundant if current is not in the child's failing set
+                if (state.pruning && merge_failing_set(state, current, depth))
                 {
-                    failure_heuristic.second[current].insert(previous);
+                    pruned = true;
+                    break;
                 }
             }
-            else if (seen.size() == failure_heuristic.first)
+        }
+
+        retract_frontier(state, current, trail_mark);
+
+        // Failure Heuristic
+        if ((unsigned int)state.num_seen > failure_heuristic.first)
+        {
+            failure_heuristic.first = state.num_seen;
+            for (unsigned int i = 0; i < failure_heuristic.second.size(); i++)
+            {
+                failure_heuristic.second[i].clear();
+            }
+            if (previous != UNDEFINED_QUBIT)
             {
-                failure_heuristic.first = seen.size();
-                if (previous != UNDEFINED_QUBIT)
-                {
-                    failure_heuristic.second[current].insert(previous);
-                }
+                failure_heuristic.second[current].insert(previous);
+            }
+        }
+        else if ((unsigned int)state.num_seen == failure_heuristic.first)
+        {
+            failure_heuristic.first = state.num_seen;
+            if (previous != UNDEFINED_QUBIT)
+            {
+                failure_heuristic.second[current].insert(previous);
             }
         }
 
+        // Every other extendable qubit fails from the same partial mapping
+        if (state.pruning)
+        {
+            if (!pruned)
+            {
+                add_conflicts(
+                    candidate_sets,
+                    candidate_edges,
+                    parents,
+                    ancestors,
+                    state,
+                    current,
+                    candidates_list.empty());
+            }
+            // Candidates given to other threads are not in the failing set
+            if (state.donated[depth])
+            {
+                failing_set = state.seen;
+            }
+            break;
+        }
     }
 
     // Failure Heuristic
-    if (seen.size() > failure_heuristic.first)
+    if ((unsigned int)state.num_seen > failure_heuristic.first)
     {
-        failure_heuristic.first = seen.size();
+        failure_heuristic.first = state.num_seen;
         for (unsigned int i = 0; i < failure_heuristic.second.size(); i++)
         {
             failure_heuristic.second[i].clear();
@@ -815,9 +2569,9 @@ backtrack_level_helper(
             failure_heuristic.second[previous].insert(previous);
         }
     }
-    else if (seen.size() == failure_heuristic.first)
+    else if ((unsigned int)state.num_seen == failure_heuristic.first)
     {
-        failure_heuristic.first = seen.size();
+        failure_heuristic.first = state.num_seen;
         if (previous != UNDEFINED_QUBIT)
         {
             failure_heuristic.second[previous].insert(previous);
@@ -827,37 +2581,39 @@ backtrack_level_helper(
 
 }
 
+template <typename Bitset>
 static bool
 backtrack_level_optimal(
     vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
     set<pair<int, int>> &couplings,
-    vector<int> &mapping,
-    set<int> &seen,
-    set<int> &mapped,
+    SearchState<Bitset> &state,
     int num_physical_qubits,
     int previous)
 {
 
-    if (query_graphs.empty())
+    // The first query graph embedded on its own
+    if (level == 1)
+    {
+        state.first_completed = true;
+    }
+
+    if (level == query_graphs.size())
     {
         return true;
     }
 
     // Input: query graph q
-    vector<set<int>> logical_graph = *query_graphs.begin();
+    vector<set<int>> &logical_graph = query_graphs[level];
 
     // Calculate size of logical island
     int logical_size = 0;
-    for_each(logical_graph.begin(), logical_graph.end(), [&logical_size](set<int> s) {
+    for_each(logical_graph.begin(), logical_graph.end(), [&logical_size](const set<int> &s) {
         logical_size += s.size();
     });
 
     // Input: data graph G
-    vector<set<int>> physical_graph = create_data_graph(couplings, num_physical_qubits, mapped);
-
-    // Backtrack(q, q_D, CS, M)
-    vector<vector<set<int>>> next_level = query_graphs;
-    next_level.erase(next_level.begin());
+    vector<Bitset> physical_graph = create_data_bitsets(couplings, num_physical_qubits, state.mapped);
 
     if (logical_size == 1)
     {
@@ -882,7 +2638,7 @@ backtrack_level_optimal(
         int physical_qubit = UNDEFINED_QUBIT;
         for (int q = 0; q < num_physical_qubits; q++)
         {
-            if (mapped.find(q) == mapped.end())
+            if (!state.mapped[q])
             {
                 physical_qubit = q;
                 break;
@@ -894,37 +2650,48 @@ backtrack_level_optimal(
             return false;
         }
 
-        seen.insert(logical_qubit);
-        mapped.insert(physical_qubit);
-        mapping[logical_qubit] = physical_qubit;
+        state.seen.set(logical_qubit);
+        state.num_seen++;
+        state.mapped.set(physical_qubit);
+        state.mapping[logical_qubit] = physical_qubit;
+        state.inverse[physical_qubit] = logical_qubit;
 
-        return backtrack_level_optimal(
-            next_level,
+        if (backtrack_level_optimal(
+            query_graphs,
+            level + 1,
             couplings,
-            mapping,
-            seen,
-            mapped,
+            state,
             num_physical_qubits,
-            logical_qubit);
+            logical_qubit))
+        {
+            return true;
+        }
+
+        state.mapping[logical_qubit] = UNDEFINED_QUBIT;
+        state.inverse[physical_qubit] = UNDEFINED_QUBIT;
+        state.mapped.reset(physical_qubit);
+        state.num_seen--;
+        state.seen.reset(logical_qubit);
+        return false;
     }
     else
     {
 
         // q_D <- BuildDAG(q, G)
-        pair<vector<set<int>>, pair<int, vector<set<int>>>> logical_dag_result = create_dag(
+        pair<vector<Bitset>, pair<int, vector<set<int>>>> logical_dag_result = create_dag(
             logical_graph,
             physical_graph);
-        vector<set<int>> candidate_sets = logical_dag_result.first;
+        vector<Bitset> candidate_sets = logical_dag_result.first;
         int dag_root = logical_dag_result.second.first;
         vector<set<int>> logical_dag = logical_dag_result.second.second;
 
         // CS <- BuildCS(q, q_D, G)
-        pair<vector<set<int>>, vector<set<int>>> candidate_space = create_candidate_space(
+        pair<vector<Bitset>, vector<Bitset>> candidate_space = create_candidate_space(
             logical_graph,
             candidate_sets,
             logical_dag,
             physical_graph);
-        vector<set<int>> candidate_edges = candidate_space.second;
+        vector<Bitset> candidate_edges = candidate_space.second;
 
         // Parents
         vector<set<int>> parents(logical_dag.size());
@@ -936,187 +2703,268 @@ backtrack_level_optimal(
             }
         }
 
-        set<int> frontier{dag_root};
-        return backtrack_level_helper_optimal(
-            next_level,
+        // Path Size Weights for the Adaptive Matching Order
+        vector<vector<double>> weights;
+        if (state.order == PATH_ORDER)
+        {
+            weights = create_path_weights(
+                candidate_sets,
+                candidate_edges,
+                parents,
+                logical_dag,
+                dag_root);
+        }
+
+        // Ancestors for the Failing Sets
+        vector<Bitset> ancestors;
+        if (state.pruning)
+        {
+            ancestors = create_ancestors(
+                parents,
+                logical_dag,
+                dag_root,
+                state.seen);
+        }
+
+        // Backtrack(q, q_D, CS, M)
+        state.frontier[dag_root] = true;
+        state.num_frontier++;
+        if (backtrack_level_helper_optimal(
+            query_graphs,
+            level + 1,
             couplings,
             candidate_sets,
             candidate_edges,
             parents,
             logical_dag,
-            mapping,
-            frontier,
-            seen,
-            mapped,
+            weights,
+            ancestors,
+            state,
             num_physical_qubits,
-            previous);
+            previous))
+        {
+            return true;
+        }
+        state.num_frontier--;
+        state.frontier[dag_root] = false;
+        return false;
     }
 }
 
+template <typename Bitset>
 static bool
 backtrack_level_helper_optimal(
     vector<vector<set<int>>> &query_graphs,
+    unsigned int level,
     set<pair<int, int>> &couplings,
-    vector<set<int>> &candidate_sets,
-    vector<set<int>> &candidate_edges,
+    vector<Bitset> &candidate_sets,
+    vector<Bitset> &candidate_edges,
     vector<set<int>> &parents,
     vector<set<int>> &query_dag,
-    vector<int> &mapping,
-    set<int> &frontier,
-    set<int> &seen,
-    set<int> &mapped,
+    vector<vector<double>> &weights,
+    vector<Bitset> &ancestors,
+    SearchState<Bitset> &state,
     int num_physical_qubits,
     int previous)
 {
 
+    int depth = state.num_seen;
+    Bitset &failing_set = state.failing_sets[depth];
+
+    // Another thread found a mapping from an earlier choice path
+    if (state.cancelled())
+    {
+        return false;
+    }
+
+    // Idle threads take the remaining candidates of the shallowest open frame
+    if (state.pool != NULL && state.pool->hungry.load(memory_order_relaxed) > 0)
+    {
+        donate_tasks(state);
+    }
+
     // If frontier is empty
-    if (frontier.empty())
+    if (state.num_frontier == 0)
     {
         // If no more query graphs, success
-        if (query_graphs.empty())
+        if (level == query_graphs.size())
         {
             return true;
         }
         // Otherwise, recursively call with new query graph
         else
         {
-            return backtrack_level_optimal(
+            if (backtrack_level_optimal(
                 query_graphs,
+                level,
                 couplings,
-                mapping,
-                seen,
-                mapped,
+                state,
                 num_physical_qubits,
-                previous);
+                previous))
+            {
+                return true;
+            }
+            // Failing Set of the next query graph is every matched qubit
+            if (state.pruning)
+            {
+                failing_set = state.seen;
+            }
+            return false;
         }
     }
 
-    // Currently ordered by int compare
-    for (int current : frontier)
+    // Adaptive Matching Order extends only the selected qubit,
+    // otherwise every extendable qubit is tried ordered by int compare
+    int selected = UNDEFINED_QUBIT;
+    if (state.order != INT_ORDER)
     {
+        selected = select_extendable(
+            candidate_sets,
+            candidate_edges,
+            parents,
+            weights,
+            state);
+    }
 
-        // If no parents, aka root
-        if (parents[current].empty())
-        {
-            set<int> new_frontier = frontier;
-            new_frontier.erase(current);
-            for (int child : query_dag[current])
-            {
-                new_frontier.insert(child);
-            }
-
-            set<int> new_seen = seen;
-            new_seen.insert(current);
-
-            vector<int> new_mapping = mapping;
-
-            set<int> new_mapped = mapped;
+    // Failing Set of this frame, every matched qubit unless narrowed below
+    if (state.pruning)
+    {
+        failing_set = state.seen;
+    }
 
-            for (int candidate : candidate_sets[current])
-            {
-                new_mapping[current] = candidate;
-                new_mapped.insert(candidate);
+    for (int current = 0; current < (int)state.frontier.size(); current++)
+    {
+        if (!state.frontier[current] ||
+            (selected != UNDEFINED_QUBIT && current != selected))
+        {
+            continue;
+        }
 
-                if (backtrack_level_helper_optimal(
-                        query_graphs,
-                        couplings,
-                        candidate_sets,
-                        candidate_edges,
-                        parents,
-                        query_dag,
-                        new_mapping,
-                        new_frontier,
-                        new_seen,
-                        new_mapped,
-                        num_physical_qubits,
-                        current))
-                {
-                    seen = new_seen;
-                    mapped = new_mapped;
-                    mapping = new_mapping;
-                    return true;
-                }
+        vector<int> &candidates_list = state.candidates[depth];
 
-                new_mapping[current] = UNDEFINED_QUBIT;
-                new_mapped.erase(candidate);
-            }
+        // If no parents, aka root
+        if (parents[current].empty())
+        {
+            candidates_list.clear();
+            candidate_sets[current].append_to(candidates_list);
         }
         // If parents
         else
         {
-            // Extendable if parents are matched
-            if (any_of(parents[current].begin(), parents[current].end(),
-                       [&seen](int parent) { return seen.find(parent) == seen.end(); }))
+            // Candidates of the selected qubit are built while selecting
+            if (selected == UNDEFINED_QUBIT)
             {
-                continue;
-            }
-            // Candidates of current vertex =
-            //     Intersection of parents' mapped candidates' adjacency list
-            set<int> candidates_list;
-            for (int candidate : candidate_sets[current])
-            {
-                if (mapped.find(candidate) != mapped.end())
+                // Extendable if parents are matched
+                if (any_of(parents[current].begin(), parents[current].end(),
+                           [&state](int parent) { return !state.seen[parent]; }))
                 {
                     continue;
                 }
-                if (all_of(parents[current].begin(), parents[current].end(),
-                           [&candidate_edges, &mapping, candidate](int parent) {
-                               return (candidate_edges[mapping[parent]].find(candidate) !=
-                                       candidate_edges[mapping[parent]].end());
-                           }))
-                {
-                    candidates_list.insert(candidate);
-                }
-            }
-
-            set<int> new_frontier = frontier;
-            new_frontier.erase(current);
-            for (int child : query_dag[current])
-            {
-                if (seen.find(child) == seen.end())
-                {
-                    new_frontier.insert(child);
-                }
+                build_candidates(
+                    candidate_sets,
+                    candidate_edges,
+                    parents,
+                    state,
+                    current,
+                    candidates_list);
             }
+        }
 
-            set<int> new_seen = seen;
-            new_seen.insert(current);
-
-            vector<int> new_mapping = mapping;
+        unsigned int trail_mark = extend_frontier(state, query_dag, current);
 
-            set<int> new_mapped = mapped;
+        bool pruned = false;
+        if (state.pruning)
+        {
+            failing_set.clear();
+        }
+        state.limits[depth] = candidates_list.size();
+        state.donated[depth] = false;
 
-            for (int candidate : candidates_list)
+        // Root candidates of the first query graph start the parallel search
+        if (depth == 0 && state.num_threads > 1)
+        {
+            if (search_parallel(
+                    query_graphs,
+                    level,
+                    couplings,
+                    candidate_sets,
+                    candidate_edges,
+                    parents,
+                    query_dag,
+                    weights,
+                    ancestors,
+                    state,
+                    num_physical_qubits,
+                    current,
+                    candidates_list,
+                    NULL))
+            {
+                return true;
+            }
+        }
+        else
+        {
+            for (unsigned int index = 0; index < state.limits[depth]; index++)
             {
-                new_mapping[current] = candidate;
-                new_mapped.insert(candidate);
+                int candidate = candidates_list[index];
+                state.path[depth] = {current, (int)index, candidate};
+                state.mapping[current] = candidate;
+                state.inverse[candidate] = current;
+                state.mapped.set(candidate);
 
                 if (backtrack_level_helper_optimal(
                         query_graphs,
+                        level,
                         couplings,
                         candidate_sets,
                         candidate_edges,
                         parents,
                         query_dag,
-                        new_mapping,
-                        new_frontier,
-                        new_seen,
-                        new_mapped,
+                        weights,
+                        ancestors,
+                        state,
                         num_physical_qubits,
                         current))
                 {
-                    seen = new_seen;
-                    mapped = new_mapped;
-                    mapping = new_mapping;
                     return true;
                 }
 
-                new_mapping[current] = UNDEFINED_QUBIT;
-                new_mapped.erase(candidate);
-            }
+                state.mapping[current] = UNDEFINED_QUBIT;
+                state.inverse[candidate] = UNDEFINED_QUBIT;
+                state.mapped.reset(candidate);
 
+                // Siblings are redundant if current is not in the child's failing set
+                if (state.pruning && merge_failing_set(state, current, depth))
+                {
+                    pruned = true;
+                    break;
+                }
+            }
         }
 
+        retract_frontier(state, current, trail_mark);
+
+        // Every other extendable qubit fails from the same partial mapping
+        if (state.pruning)
+        {
+            if (!pruned)
+            {
+                add_conflicts(
+                    candidate_sets,
+                    candidate_edges,
+                    parents,
+                    ancestors,
+                    state,
+                    current,
+                    candidates_list.empty());
+            }
+            // Candidates given to other threads are not in the failing set
+            if (state.donated[depth])
+            {
+                failing_set = state.seen;
+            }
+            break;
+        }
     }
 
     return false;
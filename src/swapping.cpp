@@ -3,87 +3,107 @@
 #include <queue>
 #include <utility>
 #include <algorithm>
+#include <cassert>
+#include <tuple>
+#include <functional>
+#include <unordered_set>
+#include <chrono>
+#include "DistanceMatrix.hpp"
+#include "SpscQueue.hpp"
+#include "SwapCache.hpp"
 using namespace std;
 
-static vector<vector<int>>
-create_distance_matrix(
-    vector<set<int>> &coupling_graph,
-    int num_physical_qubits)
+// Token Swapping Engine between consecutive Mappings
+enum SwapEngine
 {
+    APPROX_SWAPS,   // polynomial happy swap approximation
+    EXACT_SWAPS,    // A* search for the fewest swaps
+    DFS_SWAPS       // iterative deepening search
+};
 
-    // Cost Matrix
-    vector<vector<int>> cost_matrix(
-        num_physical_qubits,
-        vector<int>(
-            num_physical_qubits,
-            num_physical_qubits + 1));
-    for (int i = 0; i < num_physical_qubits; i++)
-    {
-        for (int neighbor : coupling_graph[i])
-        {
-            cost_matrix[i][neighbor] = 1;
-        }
-    }
+// Search Statistics of calculate_swaps
+struct SwapStats
+{
+    long long nodes;    // search nodes expanded by every engine
+    long long layers;   // layers of disjoint swaps over every swap block
+    double seconds;     // time calculating swaps
+    long long cache_hits;   // swap blocks reused from the swap cache
+};
 
-    // Distance Matrix
-    vector<vector<int>> distance_matrix(
-        num_physical_qubits,
-        vector<int>(
-            num_physical_qubits,
-            num_physical_qubits + 1));
-    for (int i = 0; i < num_physical_qubits; i++)
-    {
-        for (int j = 0; j < num_physical_qubits; j++)
-        {
-            distance_matrix[i][j] = cost_matrix[i][j];
-        }
-        distance_matrix[i][i] = 0;
-    }
+// Nodes the A* search may create before falling back to the approximation
+const int MAX_SWAP_NODES = 1 << 19;
 
-    // Predecessor Matrix
-    vector<vector<int>> pred_matrix(
-        num_physical_qubits,
-        vector<int>(
-            num_physical_qubits,
-            UNDEFINED_QUBIT));
+// Swap Blocks the swap cache keeps in memory and on disk
+const int MAX_CACHED_SWAPS = 1 << 12;
 
-    for (int k = 0; k < num_physical_qubits; k++)
+/**
+ * Token Positions of the Nodes of the A* search, hashed by node index
+ * so every node stores its positions once in a flat array
+ */
+struct PositionTable
+{
+    const vector<int> *positions;
+    int num_tokens;
+
+    size_t operator()(int node) const
     {
-        for (int i = 0; i < num_physical_qubits; i++)
+        size_t hash = 14695981039346656037ULL;
+        for (int i = node * num_tokens; i < (node + 1) * num_tokens; i++)
         {
-            for (int j = 0; j < num_physical_qubits; j++)
-            {
-                if (distance_matrix[i][k] + distance_matrix[k][j] < distance_matrix[i][j])
-                {
-                    distance_matrix[i][j] = distance_matrix[i][k] + distance_matrix[k][j];
-                    pred_matrix[i][j] = k;
-                }
-            }
+            hash = (hash ^ (*positions)[i]) * 1099511628211ULL;
         }
+        return hash;
     }
 
-    return distance_matrix;
-}
+    bool operator()(int node, int other) const
+    {
+        return equal(
+            positions->begin() + node * num_tokens,
+            positions->begin() + (node + 1) * num_tokens,
+            positions->begin() + other * num_tokens);
+    }
+};
 
+/**
+ * Depth-bounded search for Swaps that never increase the Cost
+ * The placement is swapped in place in both directions and undone on
+ * backtrack, so the occupant of a neighbor is one lookup
+ * @param mapping1 Input/Output: Physical Qubit of each Logical Qubit
+ * @param inverse Input/Output: Logical Qubit of each Physical Qubit
+ * @param mapping2 Input: Final Mapping
+ * @param actual_mapping Output: Final Placement if the Swaps are found
+ * @param cost Input: Sum of the Distances to the Final Mapping
+ * @param swaps Output: Swaps between Physical Qubits
+ * @param coupling_graph Input: Adjacent Physical Qubits
+ * @param distance_matrix Input: Distances between Physical Qubits
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @param depth Input: Swaps left to the Search
+ * @param nodes Output: Search Nodes expanded
+ * @returns whether the Final Mapping is reached within the depth
+ */
 static bool
 swap_qubits(
     vector<int> &mapping1,
+    vector<int> &inverse,
     vector<int> &mapping2,
-    vector<int> actual_mapping,
+    vector<int> &actual_mapping,
     int cost,
     vector<pair<int, int>> &swaps,
     vector<set<int>> &coupling_graph,
-    vector<vector<int>> &distance_matrix,
+    DistanceMatrix &distance_matrix,
     int num_logical_qubits,
-    int depth)
+    int depth,
+    long long &nodes)
 {
     if (depth < 0)
     {
         return false;
     }
+    nodes++;
 
     if (mapping1 == mapping2)
     {
+        actual_mapping = mapping1;
         return true;
     }
 
@@ -95,19 +115,17 @@ swap_qubits(
             continue;
         }
 
-        vector<int> test_mapping = mapping1;
-        for (int neighbor : coupling_graph[mapping1[i]])
+        int physical = mapping1[i];
+        for (int neighbor : coupling_graph[physical])
         {
-            unsigned int index =
-                find(test_mapping.begin(), test_mapping.end(), neighbor) -
-                test_mapping.begin();
-            int i_cost = distance_matrix[mapping1[i]][mapping2[i]];
-            int new_i_cost = distance_matrix[neighbor][mapping2[i]];
-            int neighbor_cost = index != test_mapping.size()
-                ? distance_matrix[neighbor][mapping2[index]]
+            int index = inverse[neighbor];
+            int i_cost = distance_matrix.distance(physical, mapping2[i]);
+            int new_i_cost = distance_matrix.distance(neighbor, mapping2[i]);
+            int neighbor_cost = index != UNDEFINED_QUBIT
+                ? distance_matrix.distance(neighbor, mapping2[index])
                 : coupling_graph.size() / 2;
-            int new_neighbor_cost = index != test_mapping.size()
-                ? distance_matrix[mapping1[i]][mapping2[index]]
+            int new_neighbor_cost = index != UNDEFINED_QUBIT
+                ? distance_matrix.distance(physical, mapping2[index])
                 : coupling_graph.size() / 2;
             int current_cost = cost
                 // i's swap
@@ -120,15 +138,17 @@ swap_qubits(
             {
                 continue;
             }
-            int temp = test_mapping[i];
-            test_mapping[i] = neighbor;
-            if (index != test_mapping.size())
+            mapping1[i] = neighbor;
+            inverse[neighbor] = i;
+            inverse[physical] = index;
+            if (index != UNDEFINED_QUBIT)
             {
-                test_mapping[index] = temp;
+                mapping1[index] = physical;
             }
-            swaps.push_back(pair<int, int>(temp, neighbor));
+            swaps.push_back(pair<int, int>(physical, neighbor));
             if (swap_qubits(
-                test_mapping,
+                mapping1,
+                inverse,
                 mapping2,
                 actual_mapping,
                 current_cost,
@@ -136,17 +156,19 @@ swap_qubits(
                 coupling_graph,
                 distance_matrix,
                 num_logical_qubits,
-                depth - 1))
+                depth - 1,
+                nodes))
             {
-                actual_mapping = test_mapping;
                 return true;
             }
             swaps.pop_back();
-            if (index != test_mapping.size())
+            if (index != UNDEFINED_QUBIT)
             {
-                test_mapping[index] = neighbor;
+                mapping1[index] = neighbor;
             }
-            test_mapping[i] = temp;
+            inverse[physical] = i;
+            inverse[neighbor] = index;
+            mapping1[i] = physical;
         }
 
     }
@@ -154,81 +176,738 @@ swap_qubits(
     return false;
 }
 
+/**
+ * Swap the Tokens of two adjacent Physical Qubits
+ * @param position Input/Output: Physical Qubit of each Logical Qubit
+ * @param occupant Input/Output: Logical Qubit of each Physical Qubit
+ * @param u Input: First Physical Qubit
+ * @param v Input: Second Physical Qubit
+ * @param swaps Output: Swaps performed so far
+ */
+static void
+swap_tokens(
+    vector<int> &position,
+    vector<int> &occupant,
+    int u,
+    int v,
+    vector<pair<int, int>> &swaps)
+{
+    int token_u = occupant[u];
+    int token_v = occupant[v];
+    occupant[u] = token_v;
+    occupant[v] = token_u;
+    if (token_u != UNDEFINED_QUBIT)
+    {
+        position[token_u] = v;
+    }
+    if (token_v != UNDEFINED_QUBIT)
+    {
+        position[token_v] = u;
+    }
+    swaps.push_back(pair<int, int>(u, v));
+}
+
+/**
+ * Distance gained by the Token of a Physical Qubit moving to a neighbor
+ * Empty Physical Qubits have no destination and never gain or lose
+ * @returns decrease of the distance to the destination of the token
+ */
+static int
+token_gain(
+    vector<int> &occupant,
+    vector<int> &destination,
+    DistanceMatrix &distance_matrix,
+    int from,
+    int to)
+{
+    int token = occupant[from];
+    if (token == UNDEFINED_QUBIT)
+    {
+        return 0;
+    }
+    return distance_matrix.distance(from, destination[token]) - distance_matrix.distance(to, destination[token]);
+}
+
+/**
+ * Approximate the fewest Swaps between two Mappings (Miltzow et al. 2016)
+ * Happy swaps move both tokens closer to their destinations, one at a time
+ * or in layers of disjoint swaps for a lower depth; without one,
+ * tokens are followed along shortest paths until the walk closes a cycle,
+ * which is rotated, or reaches a token at its destination, which is
+ * swapped out of the way
+ * @param mapping1 Input: Initial Mapping
+ * @param mapping2 Input: Final Mapping
+ * @param coupling_graph Input: Adjacent Physical Qubits
+ * @param distance_matrix Input: Distances between Physical Qubits
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @param swaps Output: Swaps between Physical Qubits
+ * @param parallel Input: Take every disjoint happy swap of a layer
+ * @param nodes Output: Search Nodes expanded
+ * @returns whether the swaps were found within the approximation bound
+ */
+static bool
+approximate_swaps(
+    vector<int> &mapping1,
+    vector<int> &mapping2,
+    vector<set<int>> &coupling_graph,
+    DistanceMatrix &distance_matrix,
+    int num_logical_qubits,
+    vector<pair<int, int>> &swaps,
+    bool parallel,
+    long long &nodes)
+{
+    int num_physical_qubits = coupling_graph.size();
+    vector<int> position = mapping1;
+    vector<int> occupant(num_physical_qubits, UNDEFINED_QUBIT);
+    int cost = 0;
+    for (int i = 0; i < num_logical_qubits; i++)
+    {
+        occupant[position[i]] = i;
+        cost += distance_matrix.distance(position[i], mapping2[i]);
+    }
+
+    // Unhappy swaps keep the distance, so bound the swaps to stay polynomial
+    unsigned int max_swaps = 2 * cost + num_physical_qubits;
+    vector<int> walk_index(num_physical_qubits, -1);
+    vector<int> walk;
+    vector<bool> busy(num_physical_qubits, false);
+    while (cost > 0)
+    {
+        if (swaps.size() > max_swaps)
+        {
+            return false;
+        }
+        nodes++;
+
+        // Happy Swap, else a swap into an empty or equidistant qubit,
+        // in parallel a layer of disjoint ones
+        unsigned int layer_start = swaps.size();
+        for (int level = 2; level > 0 && (parallel || swaps.size() == layer_start); level--)
+        {
+            for (int i = 0; i < num_logical_qubits && (parallel || swaps.size() == layer_start); i++)
+            {
+                int u = position[i];
+                if (busy[u])
+                {
+                    continue;
+                }
+                for (int v : coupling_graph[u])
+                {
+                    if (!busy[v] &&
+                        token_gain(occupant, mapping2, distance_matrix, u, v) +
+                        token_gain(occupant, mapping2, distance_matrix, v, u) == level)
+                    {
+                        swap_tokens(position, occupant, u, v, swaps);
+                        busy[u] = true;
+                        busy[v] = true;
+                        cost -= level;
+                        break;
+                    }
+                }
+            }
+        }
+        if (swaps.size() > layer_start)
+        {
+            for (unsigned int k = layer_start; k < swaps.size(); k++)
+            {
+                busy[swaps[k].first] = false;
+                busy[swaps[k].second] = false;
+            }
+            continue;
+        }
+
+        // Walk along shortest paths from the first misplaced token
+        int u = UNDEFINED_QUBIT;
+        for (int i = 0; i < num_logical_qubits; i++)
+        {
+            if (position[i] != mapping2[i])
+            {
+                u = position[i];
+                break;
+            }
+        }
+        walk.clear();
+        while (walk_index[u] == -1 &&
+               occupant[u] != UNDEFINED_QUBIT &&
+               mapping2[occupant[u]] != u)
+        {
+            walk_index[u] = walk.size();
+            walk.push_back(u);
+            u = distance_matrix.next_hop(u, mapping2[occupant[u]]);
+        }
+
+        // Rotate the Cycle, every token moves closer
+        if (walk_index[u] != -1)
+        {
+            int start = walk_index[u];
+            for (int k = walk.size() - 2; k >= start; k--)
+            {
+                swap_tokens(position, occupant, walk[k], walk[k + 1], swaps);
+            }
+            cost -= walk.size() - start;
+        }
+        // Unhappy Swap with the token at its destination
+        else
+        {
+            swap_tokens(position, occupant, walk.back(), u, swaps);
+        }
+
+        for (int v : walk)
+        {
+            walk_index[v] = -1;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Find the fewest Swaps between two Mappings with A*
+ * A swap moves two tokens by one edge, so half the sum of the distances
+ * is an admissible and consistent lower bound; a transposition table of
+ * the token positions keeps each permutation from being searched twice
+ * @param mapping1 Input: Initial Mapping
+ * @param mapping2 Input: Final Mapping
+ * @param coupling_graph Input: Adjacent Physical Qubits
+ * @param distance_matrix Input: Distances between Physical Qubits
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @param swaps Output: Swaps between Physical Qubits
+ * @param nodes Output: Search Nodes expanded
+ * @returns whether the swaps were found within MAX_SWAP_NODES nodes
+ */
+static bool
+astar_swaps(
+    vector<int> &mapping1,
+    vector<int> &mapping2,
+    vector<set<int>> &coupling_graph,
+    DistanceMatrix &distance_matrix,
+    int num_logical_qubits,
+    vector<pair<int, int>> &swaps,
+    long long &nodes)
+{
+    int num_physical_qubits = coupling_graph.size();
+
+    // Nodes: token positions, swaps from the start, sum of distances
+    vector<int> positions(mapping1.begin(), mapping1.begin() + num_logical_qubits);
+    vector<int> costs(1, 0);
+    vector<int> distances(1, 0);
+    vector<int> parents(1, UNDEFINED_QUBIT);
+    vector<pair<int, int>> moves(1, pair<int, int>(UNDEFINED_QUBIT, UNDEFINED_QUBIT));
+    for (int i = 0; i < num_logical_qubits; i++)
+    {
+        distances[0] += distance_matrix.distance(mapping1[i], mapping2[i]);
+    }
+
+    PositionTable table = {&positions, num_logical_qubits};
+    unordered_set<int, PositionTable, PositionTable> visited(1024, table, table);
+    visited.insert(0);
+
+    // Lowest bound first, deepest first among equal bounds
+    priority_queue<tuple<int, int, int>, vector<tuple<int, int, int>>, greater<tuple<int, int, int>>> open;
+    open.push(make_tuple((distances[0] + 1) / 2, 0, 0));
+
+    vector<int> current(num_logical_qubits);
+    vector<int> occupant(num_physical_qubits, UNDEFINED_QUBIT);
+    while (!open.empty())
+    {
+        int node = get<2>(open.top());
+        int cost = -get<1>(open.top());
+        open.pop();
+        if (cost > costs[node])
+        {
+            continue;
+        }
+        nodes++;
+
+        // Goal, Swaps from the Parents
+        if (distances[node] == 0)
+        {
+            for (; parents[node] != UNDEFINED_QUBIT; node = parents[node])
+            {
+                swaps.push_back(moves[node]);
+            }
+            reverse(swaps.begin(), swaps.end());
+            return true;
+        }
+
+        copy(
+            positions.begin() + node * num_logical_qubits,
+            positions.begin() + (node + 1) * num_logical_qubits,
+            current.begin());
+        for (int i = 0; i < num_logical_qubits; i++)
+        {
+            occupant[current[i]] = i;
+        }
+
+        // Swap every token with every neighbor, once per pair of tokens
+        for (int i = 0; i < num_logical_qubits; i++)
+        {
+            int u = current[i];
+            for (int v : coupling_graph[u])
+            {
+                int j = occupant[v];
+                if (j != UNDEFINED_QUBIT && j < i)
+                {
+                    continue;
+                }
+
+                int child = costs.size();
+                int distance = distances[node]
+                    - distance_matrix.distance(u, mapping2[i])
+                    + distance_matrix.distance(v, mapping2[i]);
+                positions.insert(positions.end(), current.begin(), current.end());
+                positions[child * num_logical_qubits + i] = v;
+                if (j != UNDEFINED_QUBIT)
+                {
+                    distance = distance
+                        - distance_matrix.distance(v, mapping2[j])
+                        + distance_matrix.distance(u, mapping2[j]);
+                    positions[child * num_logical_qubits + j] = u;
+                }
+
+                // Transposition Table
+                auto inserted = visited.insert(child);
+                if (inserted.second)
+                {
+                    costs.push_back(cost + 1);
+                    distances.push_back(distance);
+                    parents.push_back(node);
+                    moves.push_back(pair<int, int>(u, v));
+                }
+                else
+                {
+                    positions.resize(child * num_logical_qubits);
+                    child = *inserted.first;
+                    if (cost + 1 >= costs[child])
+                    {
+                        continue;
+                    }
+                    costs[child] = cost + 1;
+                    parents[child] = node;
+                    moves[child] = pair<int, int>(u, v);
+                }
+                open.push(make_tuple(cost + 1 + (distance + 1) / 2, -(cost + 1), child));
+            }
+        }
+
+        for (int i = 0; i < num_logical_qubits; i++)
+        {
+            occupant[current[i]] = UNDEFINED_QUBIT;
+        }
+
+        if (costs.size() > MAX_SWAP_NODES)
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Route every Token along a spanning tree, always within polynomial swaps
+ * Physical qubits are settled in reverse breadth first order, so the
+ * unsettled ones stay connected and a token reaches its destination
+ * through them without moving a settled token
+ * @param mapping1 Input: Initial Mapping
+ * @param mapping2 Input: Final Mapping
+ * @param coupling_graph Input: Adjacent Physical Qubits
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @param swaps Output: Swaps between Physical Qubits
+ */
+static void
+route_swaps(
+    vector<int> &mapping1,
+    vector<int> &mapping2,
+    vector<set<int>> &coupling_graph,
+    int num_logical_qubits,
+    vector<pair<int, int>> &swaps)
+{
+    int num_physical_qubits = coupling_graph.size();
+    vector<int> position = mapping1;
+    vector<int> occupant(num_physical_qubits, UNDEFINED_QUBIT);
+    vector<int> destined(num_physical_qubits, UNDEFINED_QUBIT);
+    for (int i = 0; i < num_logical_qubits; i++)
+    {
+        occupant[position[i]] = i;
+        destined[mapping2[i]] = i;
+    }
+
+    // Breadth First Order of the Physical Qubits
+    vector<int> order(1, 0);
+    vector<bool> settled(num_physical_qubits, false);
+    settled[0] = true;
+    for (unsigned int k = 0; k < order.size(); k++)
+    {
+        for (int v : coupling_graph[order[k]])
+        {
+            if (!settled[v])
+            {
+                settled[v] = true;
+                order.push_back(v);
+            }
+        }
+    }
+    fill(settled.begin(), settled.end(), false);
+
+    vector<int> parent(num_physical_qubits);
+    for (int k = order.size() - 1; k >= 0; k--)
+    {
+        int target = order[k];
+
+        // Nearest unsettled qubit holding the token, or an empty qubit
+        fill(parent.begin(), parent.end(), UNDEFINED_QUBIT);
+        parent[target] = target;
+        queue<int> frontier;
+        frontier.push(target);
+        int source = UNDEFINED_QUBIT;
+        while (!frontier.empty())
+        {
+            int u = frontier.front();
+            frontier.pop();
+            if (occupant[u] == destined[target])
+            {
+                source = u;
+                break;
+            }
+            for (int v : coupling_graph[u])
+            {
+                if (!settled[v] && parent[v] == UNDEFINED_QUBIT)
+                {
+                    parent[v] = u;
+                    frontier.push(v);
+                }
+            }
+        }
+        assert(source != UNDEFINED_QUBIT);
+
+        for (int u = source; u != target; u = parent[u])
+        {
+            swap_tokens(position, occupant, u, parent[u], swaps);
+        }
+        settled[target] = true;
+    }
+}
+
+/**
+ * Schedule Swaps into layers of disjoint swaps, each as early as the
+ * previous swaps on its qubits allow, keeping the permutation
+ * @param swaps Input/Output: Swaps between Physical Qubits, reordered by layer
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ * @returns number of layers
+ */
+static int
+layer_swaps(
+    vector<pair<int, int>> &swaps,
+    int num_physical_qubits)
+{
+    vector<int> ready(num_physical_qubits, 0);
+    vector<vector<pair<int, int>>> layers;
+    for (pair<int, int> &swap_gate : swaps)
+    {
+        unsigned int layer = max(ready[swap_gate.first], ready[swap_gate.second]);
+        if (layer == layers.size())
+        {
+            layers.push_back(vector<pair<int, int>>());
+        }
+        layers[layer].push_back(swap_gate);
+        ready[swap_gate.first] = layer + 1;
+        ready[swap_gate.second] = layer + 1;
+    }
+
+    swaps.clear();
+    for (vector<pair<int, int>> &layer : layers)
+    {
+        swaps.insert(swaps.end(), layer.begin(), layer.end());
+    }
+    return layers.size();
+}
+
+/**
+ * Calculate the Swaps between two consecutive Mappings
+ * @param mapping1 Input: Mapping before the Swaps
+ * @param mapping2 Input: Mapping after the Swaps
+ * @param coupling_graph Input: Coupling Graph
+ * @param distance_matrix Input: Distances between Physical Qubits
+ * @param layout Input: Grid Layout of the Coupling Graph, empty if none
+ * @param num_logical_qubits Input: Number of Logical Qubits
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ * @param engine Input: Token Swapping Engine
+ * @param swaps Output: Swaps between Physical Qubits
+ * @param stats Output: Search Statistics
+ */
+static void
+calculate_block_swaps(
+    vector<int> mapping1,
+    vector<int> mapping2,
+    vector<set<int>> &coupling_graph,
+    DistanceMatrix &distance_matrix,
+    vector<vector<int>> &layout,
+    int num_logical_qubits,
+    int num_physical_qubits,
+    SwapEngine engine,
+    vector<pair<int, int>> &swaps,
+    SwapStats &stats)
+{
+    vector<int> actual_mapping = mapping1;
+
+    if (!layout.empty())
+    {
+        route_layout(
+            mapping1,
+            mapping2,
+            layout,
+            num_logical_qubits,
+            swaps);
+        return;
+    }
+
+    if (engine != DFS_SWAPS)
+    {
+        // Fewest Swaps within the node bound
+        bool found = engine == EXACT_SWAPS && astar_swaps(
+            mapping1,
+            mapping2,
+            coupling_graph,
+            distance_matrix,
+            num_logical_qubits,
+            swaps,
+            stats.nodes);
+
+        // Approximate Swaps one at a time and in layers of disjoint
+        // swaps, keeping the fewest layers, then the fewest swaps
+        if (!found)
+        {
+            vector<pair<int, int>> parallel_swaps;
+            bool sequential = approximate_swaps(
+                mapping1,
+                mapping2,
+                coupling_graph,
+                distance_matrix,
+                num_logical_qubits,
+                swaps,
+                false,
+                stats.nodes);
+            bool parallel = approximate_swaps(
+                mapping1,
+                mapping2,
+                coupling_graph,
+                distance_matrix,
+                num_logical_qubits,
+                parallel_swaps,
+                true,
+                stats.nodes);
+            if (parallel && (!sequential ||
+                make_pair(layer_swaps(parallel_swaps, num_physical_qubits), parallel_swaps.size()) <
+                make_pair(layer_swaps(swaps, num_physical_qubits), swaps.size())))
+            {
+                swaps = parallel_swaps;
+            }
+            found = sequential || parallel;
+        }
+
+        // Route along a Spanning Tree
+        if (!found)
+        {
+            swaps.clear();
+            route_swaps(
+                mapping1,
+                mapping2,
+                coupling_graph,
+                num_logical_qubits,
+                swaps);
+        }
+        return;
+    }
+
+    // Occupants of the Physical Qubits
+    vector<int> inverse(num_physical_qubits, UNDEFINED_QUBIT);
+    for (int i = 0; i < num_logical_qubits; i++)
+    {
+        inverse[mapping1[i]] = i;
+    }
+
+    // Initial Cost
+    int cost = 0;
+    for (int i = 0; i < num_logical_qubits; i++)
+    {
+        if (mapping1[i] == UNDEFINED_QUBIT)
+        {
+            continue;
+        }
+        cost += distance_matrix.distance(mapping1[i], mapping2[i]);
+    }
+
+    // Find smallest swaps between 2 mappings
+    // 4-approximation Cost Lower Bound = Cost / 2 (Miltzow et al. 2016)
+    for (int depth = cost / 2; true; depth++)
+    {
+        if (swap_qubits(
+            mapping1,
+            inverse,
+            mapping2,
+            actual_mapping,
+            cost,
+            swaps,
+            coupling_graph,
+            distance_matrix,
+            num_logical_qubits,
+            depth,
+            stats.nodes))
+        {
+            // Propagate Values from Mapping 1 to Mapping 2
+            for (int i = 0; i < num_logical_qubits; i++)
+            {
+                if (mapping2[i] == UNDEFINED_QUBIT)
+                {
+                    mapping2[i] = actual_mapping[i];
+                }
+            }
+            return;
+        }
+        else
+        {
+            swaps.clear();
+        }
+    }
+}
+
+/**
+ * Hash the Coupling Graph and the routing options of the swap cache
+ * @param couplings Input: Coupling Graph Edges
+ * @param num_physical_qubits Input: Number of Physical Qubits
+ * @param engine Input: Token Swapping Engine
+ * @param topology Input: Topology Hint
+ * @returns FNV-1a hash
+ */
+static unsigned long long
+hash_couplings(
+    set<pair<int, int>> &couplings,
+    int num_physical_qubits,
+    SwapEngine engine,
+    Topology topology)
+{
+    vector<int> values = {num_physical_qubits, (int)engine, (int)topology};
+    for (const pair<int, int> &edge : couplings)
+    {
+        values.push_back(edge.first);
+        values.push_back(edge.second);
+    }
+
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int value : values)
+    {
+        hash = (hash ^ (unsigned int)value) * 1099511628211ULL;
+    }
+    return hash;
+}
+
 vector<vector<pair<int, int>>>
 calculate_swaps(
     vector<pair<pair<int, int>, vector<int>>> &mappings,
     set<pair<int, int>> &couplings,
     int num_logical_qubits,
-    int num_physical_qubits)
+    int num_physical_qubits,
+    SwapEngine engine,
+    Topology topology,
+    SwapStats &stats,
+    char *cache_file_name,
+    SpscQueue<pair<pair<int, int>, vector<int>>> *pipeline)
 {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    stats.nodes = 0;
+    stats.layers = 0;
+    stats.cache_hits = 0;
+
+    // Swap Blocks of previous transitions, and runs if stored on disk
+    SwapCache cache(MAX_CACHED_SWAPS, hash_couplings(couplings, num_physical_qubits, engine, topology));
+    if (cache_file_name != NULL)
+    {
+        cache.load(cache_file_name);
+    }
 
     // Construct coupling graph
     vector<set<int>> coupling_graph = create_data_graph(
         couplings,
         num_physical_qubits,
-        set<int>());
+        vector<bool>(num_physical_qubits, false));
 
     // Build distance matrix
-    vector<vector<int>> distance_matrix = create_distance_matrix(
-        coupling_graph,
-        num_physical_qubits);
+    DistanceMatrix distance_matrix(coupling_graph);
+
+    // Lines and Grids are routed without search, unless the fewest swaps
+    // are asked for without a topology hint
+    vector<vector<int>> layout;
+    if (topology != GENERAL_TOPOLOGY && (topology != AUTO_TOPOLOGY || engine == APPROX_SWAPS))
+    {
+        layout = create_layout(coupling_graph, topology);
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
     // Total Swaps
-    vector<vector<pair<int, int>>> swaps(mappings.size() - 1);
+    vector<vector<pair<int, int>>> swaps;
 
-    // Iterate mappings by pairs
-    for (unsigned int index = 0; index < mappings.size() - 1; index++)
+    // Iterate mappings by pairs, as the partitioner finds them if pipelined
+    pair<pair<int, int>, vector<int>> next_mapping;
+    for (unsigned int index = 0; true; index++)
     {
-        vector<pair<int, int>> local_swaps;
-        vector<int> mapping1 = mappings[index].second;
-        vector<int> mapping2 = mappings[index + 1].second;
-        vector<int> actual_mapping = mapping1;
+        // Wait until the partitioner finds the Mapping after this one
+        while (pipeline != NULL && index + 1 >= mappings.size() && pipeline->pop(next_mapping))
+        {
+            mappings.push_back(next_mapping);
+        }
+        if (index + 1 >= mappings.size())
+        {
+            break;
+        }
 
-        // Initial Cost
-        int cost = 0;
+        start = chrono::steady_clock::now();
+
+        // Destination of the token on each Physical Qubit
+        vector<int> permutation(num_physical_qubits, UNDEFINED_QUBIT);
         for (int i = 0; i < num_logical_qubits; i++)
         {
-            if (mapping1[i] == UNDEFINED_QUBIT)
+            if (mappings[index].second[i] != UNDEFINED_QUBIT)
             {
-                continue;
+                permutation[mappings[index].second[i]] = mappings[index + 1].second[i];
             }
-            cost += distance_matrix[mapping1[i]][mapping2[i]];
         }
 
-        // Find smallest swaps between 2 mappings
-        // 4-approximation Cost Lower Bound = Cost / 2 (Miltzow et al. 2016)
-        for (int depth = cost / 2; true; depth++)
+        vector<pair<int, int>> local_swaps;
+        const vector<pair<int, int>> *cached_swaps = cache.find(permutation);
+        if (cached_swaps != NULL)
         {
-            if (swap_qubits(
-                mapping1,
-                mapping2,
-                actual_mapping,
-                cost,
-                local_swaps,
+            local_swaps = *cached_swaps;
+            stats.cache_hits++;
+        }
+        else
+        {
+            calculate_block_swaps(
+                mappings[index].second,
+                mappings[index + 1].second,
                 coupling_graph,
                 distance_matrix,
+                layout,
                 num_logical_qubits,
-                depth))
-            {
-                // Assign Swaps
-                swaps[index] = local_swaps;
+                num_physical_qubits,
+                engine,
+                local_swaps,
+                stats);
+        }
 
-                // Propagate Values from Mapping 1 to Mapping 2
-                for (int i = 0; i < num_logical_qubits; i++)
-                {
-                    if (mapping2[i] == UNDEFINED_QUBIT)
-                    {
-                        mapping2[i] = actual_mapping[i];
-                    }
-                }
-                break;
-            }
-            else
-            {
-                local_swaps.clear();
-            }
+        // Disjoint Swaps in parallel
+        stats.layers += layer_swaps(local_swaps, num_physical_qubits);
+        if (cached_swaps == NULL)
+        {
+            cache.insert(permutation, local_swaps);
         }
+        swaps.push_back(local_swaps);
+        stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
     }
 
+    if (cache_file_name != NULL && !cache.save(cache_file_name))
+    {
+        cerr << "Cannot write the swap cache " << cache_file_name << endl;
+    }
     return swaps;
 }
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Usage: ./throughput.sh "path/to/mapper [flags]" ["path/to/other/mapper [flags]" ...]
+#
+# Runs each mapper command with -stats on the same circuits and couplings,
+# then prints the swap search nodes per second of every command per circuit.
+# Compare swap engines of the same binary, e.g.
+#   ./throughput.sh "./mapper -swap dfs" "./mapper -swap exact"
+# or the QASM reader on large circuits, e.g.
+#   RATE="Read MB per Second" CIRCUITS="./circuits/large/*.qasm" ./throughput.sh
+
+# Circuits to Benchmark
+circuits=${CIRCUITS:-"./circuits/small/*.qasm"}
+
+# Couplings to Benchmark
+couplings=${COUPLINGS:-"./couplings/tokyo.txt"}
+
+# Statistic of -stats to Compare
+rate_name=${RATE:-"Swap Nodes per Second"}
+
+# Seconds before a run is Killed
+limit=${TIMEOUT:-60}
+
+# Mappers to Compare
+mappers=("$@")
+if [[ ${#mappers[@]} -eq 0 ]]
+then
+    mappers=("./mapper -swap dfs")
+fi
+
+echo "circuit coupling $rate_name per command"
+
+# For every QASM
+for circuitfile in $circuits; do
+    # For every Coupling Graph
+    for couplingfile in $couplings; do
+        line="$(basename $circuitfile .qasm) $(basename $couplingfile .txt)"
+        # For every Mapper
+        for mapper in "${mappers[@]}"; do
+            rate=$(timeout $limit $mapper $circuitfile $couplingfile -stats 2>&1 > /dev/null |
+                awk -v name="$rate_name: " 'index($0, name) == 1 { print $NF }')
+            line="$line ${rate:-killed}"
+        done
+        echo "$line"
+    done
+done
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Usage: ./verify.sh ["path/to/mapper [flags]"]
+#
+# Runs the mapper with -verify on every circuit and coupling, so the depth
+# and number of gates it counts while compiling are checked against the
+# QASMparser layers of the compiled circuit, then prints every mismatch.
+
+# Circuits to Verify
+circuits=${CIRCUITS:-"./circuits/small/*.qasm"}
+
+# Couplings to Verify
+couplings=${COUPLINGS:-"./couplings/*.txt"}
+
+# Seconds before a run is Killed
+limit=${TIMEOUT:-60}
+
+# Mapper to Verify
+mapper=${1:-"./mapper"}
+
+checked=0
+failed=0
+
+# For every QASM
+for circuitfile in $circuits; do
+    # For every Coupling Graph
+    for couplingfile in $couplings; do
+        errors=$(timeout $limit $mapper $circuitfile $couplingfile -verify 2>&1 > /dev/null)
+        status=$?
+        # Fewer physical than logical qubits
+        if [[ $status -eq 134 ]] && [[ $errors == *num_physical_qubits* ]]
+        then
+            continue
+        fi
+        checked=$((checked + 1))
+        if [[ $status -ne 0 ]]
+        then
+            failed=$((failed + 1))
+            echo "$(basename $circuitfile .qasm) $(basename $couplingfile .txt): ${errors:-exit $status}"
+        fi
+    done
+done
+
+echo "$((checked - failed)) of $checked runs verified"
+[[ $failed -eq 0 ]]